@@ -25,365 +25,387 @@
 
 namespace {
 
-// Precomputed magic multipliers.
-// TODO: It is possible to write clean code to initialize these numbers instead of hardcode them.
-const Bitboard bishop_magics[SQUARES] = {
-	2305922208415879456,
-	2450002178294317056,
-	2328361231763636234,
-	2315993846590472192,
-	2305983888440166400,
-	2306001339429195776,
-	2308174008291491856,
-	2882866730865295488,
-	2378399798844721168,
-	2308099379008913420,
-	2305862835336421376,
-	2305844125905356304,
-	2956693763453379267,
-	2326109487787675650,
-	2310348812706648064,
-	2314868900839393792,
-	2326109216395493408,
-	2497282289609749632,
-	2900335766238412810,
-	2594144871891601408,
-	2595209464378425344,
-	3602917162634715201,
-	2332882203459477568,
-	2315413176206009346,
-	2307039278183613456,
-	2325002549754864896,
-	2344688759330832392,
-	2632362778293305376,
-	2882449447680221184,
-	2306969046760947776,
-	2551289326449297472,
-	2308175073376538656,
-	2305896369888166016,
-	2378182152322818146,
-	2310351011249782800,
-	2305915579146961024,
-	3476779050306240640,
-	2308253139913410560,
-	2307144901848203289,
-	2306173413011505188,
-	2306969562022674692,
-	2333014140861809024,
-	2379590552761991424,
-	3026419087571421184,
-	2643657034747085824,
-	2316116991893574144,
-	2314852408599117840,
-	2459000722720556545,
-	2307567090695933952,
-	3170542959533752836,
-	2330624352307388480,
-	2341871877234370560,
-	2306160836861822976,
-	2314991227353174080,
-	2307267985145866240,
-	3611966071361276032,
-	2306986527093692672,
-	2306408433337447424,
-	2594154768561635460,
-	2305896065148190784,
-	2594075034700022794,
-	2341874349258179218,
-	2305845345676959936,
-	2306126694052004227
+// Precomputed magic multipliers. Each one maps the occupancy of its mask
+// to exactly 2^bits entries, bits being the population of the mask.
+constexpr Bitboard bishop_magics[SQUARES] = {
+	1157460297201095712ULL,
+	9232383651341680648ULL,
+	1175729775978873288ULL,
+	5909853148649881736ULL,
+	2451102138206519298ULL,
+	1441437891287842816ULL,
+	288379927181664260ULL,
+	11294741796757536ULL,
+	1513249167005257216ULL,
+	9223688702679714368ULL,
+	4611757491029213184ULL,
+	9223939454681481472ULL,
+	4616190787376513080ULL,
+	1117245423616ULL,
+	1513245793174292992ULL,
+	9223381399892395296ULL,
+	289638026181869824ULL,
+	1154472031019073800ULL,
+	2812498521377472529ULL,
+	4631987418369659136ULL,
+	6773270820945956ULL,
+	844450718351617ULL,
+	9224638884842377216ULL,
+	9229041196125521920ULL,
+	1935690489933888ULL,
+	360574161325922304ULL,
+	10385353517408731205ULL,
+	618127844951851072ULL,
+	1153204081294065664ULL,
+	5765736722559139968ULL,
+	1126184112956416ULL,
+	583319242688530ULL,
+	1157443263432492096ULL,
+	659779619629056256ULL,
+	2307540672497975332ULL,
+	1157460426583703680ULL,
+	11533719204043694592ULL,
+	2348628653077794820ULL,
+	567434981476369ULL,
+	9235196193489858712ULL,
+	2534720315342944ULL,
+	4611829025840041985ULL,
+	72093878999713792ULL,
+	576461027454519808ULL,
+	2305851878388285504ULL,
+	5516349411426304130ULL,
+	297294763468671042ULL,
+	1339862671712846352ULL,
+	143108348051464ULL,
+	151736922669056ULL,
+	3476779135970836513ULL,
+	3476824001442498560ULL,
+	5338173208468193354ULL,
+	9227910831625340801ULL,
+	9042595189657745ULL,
+	31577999728976144ULL,
+	18155720125325384ULL,
+	141854192714784ULL,
+	2256199001834561ULL,
+	9457568014116586513ULL,
+	4364206592ULL,
+	140772130160768ULL,
+	288321653082423808ULL,
+	4629823716867646020ULL
 };
 
-const Bitboard rook_magics[SQUARES] {
-	2630102251644911749,
-	2792231804940076050,
-	3602884142894944384,
-	3602884374854371376,
-	2882444567859183648,
-	3819054718207131904,
-	3746996548371547144,
-	2449960544522816515,
-	2305852356146827264,
-	2305966189949489152,
-	2379615842603114496,
-	2459106686540066816,
-	2308939302711132416,
-	2306405976905515520,
-	2388044697546260608,
-	2603093847498080384,
-	2378252721852685312,
-	3463833468584069376,
-	2306142084968230912,
-	2306166265848270912,
-	2327236207106461952,
-	2306408708013297792,
-	2405216870149407236,
-	2615834953870508704,
-	2306142523321647104,
-	2315703431672631296,
-	2310346652193398784,
-	3242802898069496320,
-	2305984846348157440,
-	2451227035855553536,
-	3458765621922381956,
-	2317102567165804800,
-	2668382856794996992,
-	2346393272928176160,
-	2324446814945674304,
-	2324983316221005824,
-	2306126691820374032,
-	2310815000929256448,
-	2305915578071646340,
-	2305855654671680544,
-	2305860876279775232,
-	2594091287325982720,
-	2319353825462329344,
-	2306986501442898432,
-	2307127307648635392,
-	2310347725575684098,
-	2305844385785053192,
-	2379307980819550216,
-	2305896962601263616,
-	2377918231982703104,
-	2306406234884243968,
-	2305852923074707520,
-	2639180042441130560,
-	2310364275249545728,
-	3891673308382626304,
-	3459934412181930080,
-	3189534595729261058,
-	2346415026938709010,
-	3458773585062167042,
-	2308099216470315530,
-	2630104381961797906,
-	2310364759377121322,
-	3458770022251497540,
-	2341878970410083586
+constexpr Bitboard rook_magics[SQUARES] = {
+	1188950576646328352ULL,
+	594485183902658560ULL,
+	1801475035592919296ULL,
+	612507141642650752ULL,
+	4755818816406553088ULL,
+	9295431834211451904ULL,
+	144119590694707712ULL,
+	144115738907640849ULL,
+	289497015765697056ULL,
+	70437467856896ULL,
+	37717717765194816ULL,
+	290622947814539904ULL,
+	2814827093559328ULL,
+	9820239733568307328ULL,
+	4611967497699328512ULL,
+	306807728944205956ULL,
+	10412323438537490688ULL,
+	18085042133667849ULL,
+	141287512612873ULL,
+	2449968093461479680ULL,
+	2252349703979136ULL,
+	1126174818369600ULL,
+	4789472784896066ULL,
+	10995140821252ULL,
+	140739637952521ULL,
+	2310346889087688705ULL,
+	10952789488875602048ULL,
+	1152939098940899456ULL,
+	306807767564587040ULL,
+	2377905003445747840ULL,
+	576480560702030152ULL,
+	4508040624768321ULL,
+	2882444773891768368ULL,
+	1157425241677365313ULL,
+	4611721203084706048ULL,
+	436849731067447296ULL,
+	288371268300834816ULL,
+	13907117850499220480ULL,
+	562984346715137ULL,
+	108658517241496577ULL,
+	153157846589014016ULL,
+	2909342952541274146ULL,
+	281612483887168ULL,
+	11029333363084886048ULL,
+	1134696067006592ULL,
+	4507997707468928ULL,
+	2310909870196523012ULL,
+	9439690110271619089ULL,
+	38351208276099584ULL,
+	585538322451988736ULL,
+	76720623935554304ULL,
+	576759830204122240ULL,
+	162693155150366208ULL,
+	1153484474043859456ULL,
+	18155144587837568ULL,
+	40954610201919616ULL,
+	35815737032705ULL,
+	342555201619771393ULL,
+	144150372632498241ULL,
+	8070468124503181569ULL,
+	9223935124315310082ULL,
+	3459045997526384647ULL,
+	614778835619098628ULL,
+	4611686191308472594ULL
 };
 }
 
 namespace Attacks {
 
-	// Non sliding pieces
-	Bitboard knight_attacks[SQUARES];
-	Bitboard pawn_attacks[PLAYERS][SQUARES];
-	Bitboard king_attacks[SQUARES];
-	Bitboard king_castling[PLAYERS][SQUARES];
-
-	// Magic multipliers
-	Magic bishop_magic_table[SQUARES];
-	Magic rook_magic_table[SQUARES];
-
-	// Sliding pieces
-	Bitboard bishop_attacks[512][SQUARES]; // 256 KB
-	Bitboard rook_attacks[4096][SQUARES]; // 2MB
-
-	// Mobility
-	int bishop_mobility[512][SQUARES];
-	int rook_mobility[4096][SQUARES];
-
-	// Attack tables initialization
-	void init_knight_attacks();
-	void init_pawn_attacks();
-	void init_king_attacks();
-	void init_magic_bitboards();
-
 	/*
-	 * Initializes the attack tables for move generation
-	 * and evaluation.
+	 * Helpers to compute the tables at compile time.
 	 */
-	void init() {
-		init_knight_attacks();
-		init_pawn_attacks();
-		init_king_attacks();
-		init_magic_bitboards();
+	constexpr Bitboard square_bb(int square) {
+		return Bitboard(1) << square;
+	}
+
+	constexpr int distance(int square_1, int square_2) {
+		int files_distance = (square_1 % 8) - (square_2 % 8);
+		int ranks_distance = (square_1 / 8) - (square_2 / 8);
+		files_distance = files_distance < 0 ? -files_distance : files_distance;
+		ranks_distance = ranks_distance < 0 ? -ranks_distance : ranks_distance;
+		return files_distance > ranks_distance ? files_distance : ranks_distance;
 	}
 
 	/*
-	 * Initializes the knight attacks table.
+	 * Computes the knight attacks table.
 	 */
-	void init_knight_attacks() {
+	constexpr Square_bitboards init_knight_attacks() {
+		Square_bitboards attacks = {};
 		for (int rank = RANK_1; rank <= RANK_8; rank++) {
 			for (int file = FILE_A; file <= FILE_H; file++) {
 				int square = rank * 8 + file;
 				if (rank >= RANK_3 && file >= FILE_B)
-					Bitboards::set_bit(knight_attacks[square], square + SOUTH + SOUTH_WEST);
+					attacks[square] |= square_bb(square + SOUTH + SOUTH_WEST);
 				if (rank >= RANK_3 && file <= FILE_G)
-					Bitboards::set_bit(knight_attacks[square], square + SOUTH + SOUTH_EAST);
+					attacks[square] |= square_bb(square + SOUTH + SOUTH_EAST);
 				if (rank >= RANK_2 && file >= FILE_C)
-					Bitboards::set_bit(knight_attacks[square], square + WEST + SOUTH_WEST);
+					attacks[square] |= square_bb(square + WEST + SOUTH_WEST);
 				if (rank >= RANK_2 && file <= FILE_F)
-					Bitboards::set_bit(knight_attacks[square], square + EAST + SOUTH_EAST);
+					attacks[square] |= square_bb(square + EAST + SOUTH_EAST);
 				if (rank <= RANK_7 && file >= FILE_C)
-					Bitboards::set_bit(knight_attacks[square], square + WEST + NORTH_WEST);
+					attacks[square] |= square_bb(square + WEST + NORTH_WEST);
 				if (rank <= RANK_7 && file <= FILE_F)
-					Bitboards::set_bit(knight_attacks[square], square + EAST + NORTH_EAST);
+					attacks[square] |= square_bb(square + EAST + NORTH_EAST);
 				if (rank <= RANK_6 && file >= FILE_B)
-					Bitboards::set_bit(knight_attacks[square], square + NORTH + NORTH_WEST);
+					attacks[square] |= square_bb(square + NORTH + NORTH_WEST);
 				if (rank <= RANK_6 && file <= FILE_G)
-					Bitboards::set_bit(knight_attacks[square], square + NORTH + NORTH_EAST);
+					attacks[square] |= square_bb(square + NORTH + NORTH_EAST);
 			}
 		}
+		return attacks;
 	}
 
 	/*
-	 * Initializes the pawn attacks table for each side.
+	 * Computes the pawn attacks table for each side.
 	 */
-	void init_pawn_attacks() {
+	constexpr std::array<Square_bitboards, PLAYERS> init_pawn_attacks() {
+		std::array<Square_bitboards, PLAYERS> attacks = {};
 		for (int rank = RANK_1; rank <= RANK_8; rank++) {
 			for (int file = FILE_A; file <= FILE_H; file++) {
 				int square = rank * 8 + file;
 				if (rank <= RANK_7) {
 					if (file >= FILE_B)
-						Bitboards::set_bit(pawn_attacks[WHITE][square], square + NORTH_WEST);
+						attacks[WHITE][square] |= square_bb(square + NORTH_WEST);
 					if (file <= FILE_G)
-						Bitboards::set_bit(pawn_attacks[WHITE][square], square + NORTH_EAST);
+						attacks[WHITE][square] |= square_bb(square + NORTH_EAST);
 				}
 				if (rank >= RANK_2) {
 					if (file >= FILE_B)
-						Bitboards::set_bit(pawn_attacks[BLACK][square], square + SOUTH_WEST);
+						attacks[BLACK][square] |= square_bb(square + SOUTH_WEST);
 					if (file <= FILE_G)
-						Bitboards::set_bit(pawn_attacks[BLACK][square], square + SOUTH_EAST);
+						attacks[BLACK][square] |= square_bb(square + SOUTH_EAST);
 				}
 			}
 		}
+		return attacks;
 	}
 
 	/*
-	 * Initializes the king attacks table.
+	 * Computes the king attacks table.
 	 */
-	void init_king_attacks() {
+	constexpr Square_bitboards init_king_attacks() {
+		Square_bitboards attacks = {};
 		for (int rank = RANK_1; rank <= RANK_8; rank++) {
 			for (int file = FILE_A; file <= FILE_H; file++) {
 				int square = rank * 8 + file;
 				if (rank >= RANK_2 && file >= FILE_B)
-					Bitboards::set_bit(king_attacks[square], square + SOUTH_WEST);
+					attacks[square] |= square_bb(square + SOUTH_WEST);
 				if (rank >= RANK_2)
-					Bitboards::set_bit(king_attacks[square], square + SOUTH);
+					attacks[square] |= square_bb(square + SOUTH);
 				if (rank >= RANK_2 && file <= FILE_G)
-					Bitboards::set_bit(king_attacks[square], square + SOUTH_EAST);
+					attacks[square] |= square_bb(square + SOUTH_EAST);
 				if (file >= FILE_B)
-					Bitboards::set_bit(king_attacks[square], square + WEST);
+					attacks[square] |= square_bb(square + WEST);
 				if (file <= FILE_G)
-					Bitboards::set_bit(king_attacks[square], square + EAST);
+					attacks[square] |= square_bb(square + EAST);
 				if (rank <= RANK_7 && file >= FILE_B)
-					Bitboards::set_bit(king_attacks[square], square + NORTH_WEST);
+					attacks[square] |= square_bb(square + NORTH_WEST);
 				if (rank <= RANK_7)
-					Bitboards::set_bit(king_attacks[square], square + NORTH);
+					attacks[square] |= square_bb(square + NORTH);
 				if (rank <= RANK_7 && file <= FILE_G)
-					Bitboards::set_bit(king_attacks[square], square + NORTH_EAST);
+					attacks[square] |= square_bb(square + NORTH_EAST);
 			}
 		}
+		return attacks;
 	}
 
-	// Auxiliary functions for magic bitboards
-	Bitboard sliding_attacks(int square, Bitboard occupied_squares, Direction directions[4]);
-	int distance(int square_1, int square_2);
-	void load_magic_table(Magic magic_table[], Bitboard attack_table[][SQUARES], int mobility_table[][SQUARES], Direction directions[4], Piece_type piece);
-	void load_magic_numbers();
-
 	/*
-	 * Loads the magic multipliers and initializes
-	 * the attacks tables for the sliding pieces.
+	 * Returns a bitboard with the squares reached from a square
+	 * in one direction, up to the first occupied square.
 	 */
-	void init_magic_bitboards() {
-		load_magic_numbers();
-		Direction bishop_directions[] = {SOUTH_WEST, SOUTH_EAST, NORTH_WEST, NORTH_EAST};
-		load_magic_table(bishop_magic_table, bishop_attacks, bishop_mobility, bishop_directions, BISHOP);
-		Direction rook_directions[] = {SOUTH, EAST, NORTH, WEST};
-		load_magic_table(rook_magic_table, rook_attacks, rook_mobility, rook_directions, ROOK);
+	constexpr Bitboard ray_attacks(int square, Bitboard occupied_squares, Direction direction) {
+		Bitboard attacks = 0;
+		int s = square + direction;
+		while (0 <= s && s < 64 && distance(s, s - direction) == 1) {
+			attacks |= square_bb(s);
+			if (occupied_squares & square_bb(s))
+				break;
+			s += direction;
+		}
+		return attacks;
 	}
 
 	/*
-	 * Loads the magic multipliers.
+	 * Returns a bitboard with the attacks for a sliding piece on a certain square
+	 * using the directions provided.
 	 */
-	void load_magic_numbers() {
-		for (int square = A1; square <= H8; square++) {
-			bishop_magic_table[square].magic_number = bishop_magics[square];
-			rook_magic_table[square].magic_number = rook_magics[square];
-		}
+	constexpr Bitboard sliding_attacks(int square, Bitboard occupied_squares, const Direction directions[4]) {
+		Bitboard attacks = 0;
+		for (int dir = 0; dir < 4; dir++)
+			attacks |= ray_attacks(square, occupied_squares, directions[dir]);
+		return attacks;
 	}
 
+	constexpr Direction bishop_directions[4] = {SOUTH_WEST, SOUTH_EAST, NORTH_WEST, NORTH_EAST};
+	constexpr Direction rook_directions[4] = {SOUTH, EAST, NORTH, WEST};
+
 	/*
-	 * Loads the attack and mobility tables for the sliding pieces.
+	 * Computes the mask, magic multiplier and slice of the attack tables
+	 * of each square. The slices are laid out one after another.
 	 */
-	void load_magic_table(Magic magic_table[], Bitboard attack_table[][64], int mobility_table[][64], Direction directions[4], Piece_type piece) {
-		int shift = piece == BISHOP ? 55 : 52;
+	constexpr std::array<Magic, SQUARES> init_magic_table(const Bitboard magics[SQUARES], const Direction directions[4]) {
+		std::array<Magic, SQUARES> magic_table = {};
+		unsigned int offset = 0;
 		for (int square = A1; square <= H8; square++) {
-			// Compute the mask
-			Bitboard empty = 0;
 			int file = square % 8;
 			int rank = square / 8;
-	        Bitboard board_edges = ((Bitboards::ranks_bb[RANK_1] | Bitboards::ranks_bb[RANK_8]) & ~Bitboards::ranks_bb[rank]) | ((Bitboards::files_bb[FILE_A]  | Bitboards::files_bb[FILE_H]) & ~Bitboards::files_bb[file]);
-			magic_table[square].mask = sliding_attacks(square, empty, directions) & ~board_edges;
-
-			// Compute the attack bitboard and mobility for each subset of the mask
-			Bitboard b = 0;
-			int table_size = 0;
-			do {
-				Bitboard index = ((b & magic_table[square].mask) * magic_table[square].magic_number) >> shift;
-				attack_table[index][square] = sliding_attacks(square, b, directions);
-				mobility_table[index][square] = Bitboards::population_count(attack_table[index][square]);
-				table_size++;
-				b = (b - magic_table[square].mask) & magic_table[square].mask;
-
-			} while (b);
+			Bitboard board_edges = ((0xFFULL | (0xFFULL << 56)) & ~(0xFFULL << (8 * rank))) |
+					((0x0101010101010101ULL | (0x0101010101010101ULL << 7)) & ~(0x0101010101010101ULL << file));
+			Bitboard mask = sliding_attacks(square, 0, directions) & ~board_edges;
+			int bits = Bitboards::population_count(mask);
+			magic_table[square] = {mask, magics[square], offset, (unsigned int) (64 - bits)};
+			offset += 1 << bits;
 		}
+		return magic_table;
 	}
 
+	// Non sliding pieces
+	constexpr Square_bitboards knight_attacks = init_knight_attacks();
+	constexpr std::array<Square_bitboards, PLAYERS> pawn_attacks = init_pawn_attacks();
+	constexpr Square_bitboards king_attacks = init_king_attacks();
+	Bitboard king_castling[PLAYERS][SQUARES];
+
+	// Magic multipliers
+	constexpr std::array<Magic, SQUARES> bishop_magic_table = init_magic_table(bishop_magics, bishop_directions);
+	constexpr std::array<Magic, SQUARES> rook_magic_table = init_magic_table(rook_magics, rook_directions);
+
+	static_assert(bishop_magic_table[H8].offset + (1u << (64 - bishop_magic_table[H8].shift)) == BISHOP_TABLE_SIZE, "Bishop table size");
+	static_assert(rook_magic_table[H8].offset + (1u << (64 - rook_magic_table[H8].shift)) == ROOK_TABLE_SIZE, "Rook table size");
+
+	// Sliding pieces
+	Bitboard bishop_attacks[BISHOP_TABLE_SIZE]; // 41 KB
+	Bitboard rook_attacks[ROOK_TABLE_SIZE]; // 800 KB
+
+	// Mobility
+	unsigned char bishop_mobility[BISHOP_TABLE_SIZE];
+	unsigned char rook_mobility[ROOK_TABLE_SIZE];
+
+	// Sliding attacks backend
+	bool use_pext = false;
+
+	void init_sliding_backend();
+	void load_magic_table(const std::array<Magic, SQUARES> &magic_table, Bitboard attack_table[], unsigned char mobility_table[],
+			const Direction directions[4], unsigned int (*get_index)(Bitboard, int));
+
 	/*
-	 * Returns a bitboard with the attacks for a sliding piece on a certain square
-	 * using the directions provided.
+	 * Fills the attack tables for the sliding pieces. Everything else
+	 * is computed at compile time, but these depend on the backend.
 	 */
-	Bitboard sliding_attacks(int square, Bitboard occupied_squares, Direction directions[4]) {
-		Bitboard attacks = 0;
-		for (int dir = 0; dir < 4; dir++) {
-			int s = square + directions[dir];
-			while (0 <= s && s < 64 && distance(s, s - directions[dir]) == 1) {
-				Bitboard uno = 1;
-				Bitboard set_mask = uno << s;
-				Bitboards::set_bit(attacks, s);
-				attacks |= set_mask;
-				if (occupied_squares & set_mask)
-					break;
-				s += directions[dir];
-			}
-		}
-		return attacks;
+	void init() {
+		init_sliding_backend();
+		load_magic_table(bishop_magic_table, bishop_attacks, bishop_mobility, bishop_directions, get_bishop_index);
+		load_magic_table(rook_magic_table, rook_attacks, rook_mobility, rook_directions, get_rook_index);
 	}
 
 	/*
-	 * Returns the distance between two squares.
+	 * Chooses the backend for the sliding attacks with cpuid.
+	 * It must be chosen before the tables are filled,
+	 * because the index of every entry depends on it.
 	 */
-	int distance(int square_1, int square_2) {
-		int file_1 = square_1 % 8;
-		int RANK_1 = square_1 / 8;
-		int file_2 = square_2 % 8;
-		int RANK_2 = square_2 / 8;
-		int files_distance = abs(file_1 - file_2);
-		int ranks_distance = abs(RANK_1 - RANK_2);
-		return files_distance > ranks_distance ? files_distance : ranks_distance;
+	void init_sliding_backend() {
+#ifdef PEXT_BACKEND
+		use_pext = __builtin_cpu_supports("bmi2");
+#endif
 	}
 
+	/*
+	 * Loads the attack and mobility tables for the sliding pieces.
+	 */
+	void load_magic_table(const std::array<Magic, SQUARES> &magic_table, Bitboard attack_table[], unsigned char mobility_table[],
+			const Direction directions[4], unsigned int (*get_index)(Bitboard, int)) {
+		for (int square = A1; square <= H8; square++) {
+			Bitboard rays[4];
+			for (int dir = 0; dir < 4; dir++)
+				rays[dir] = ray_attacks(square, 0, directions[dir]);
+
+			// Compute the attack bitboard and mobility for each subset of the mask:
+			// each ray is cut at its first blocker
+			Bitboard b = 0;
+			do {
+				Bitboard attacks = 0;
+				for (int dir = 0; dir < 4; dir++) {
+					Bitboard blockers = rays[dir] & b;
+					if (!blockers) {
+						attacks |= rays[dir];
+						continue;
+					}
+					int blocker = directions[dir] > 0 ? Bitboards::bit_scan_forward(blockers) : Bitboards::bit_scan_reverse(blockers);
+					attacks |= Bitboards::between_bb[square][blocker] | square_bb(blocker);
+				}
+				unsigned int index = get_index(b, square);
+				attack_table[index] = attacks;
+				mobility_table[index] = Bitboards::population_count(attacks);
+				b = (b - magic_table[square].mask) & magic_table[square].mask;
+
+			} while (b);
+		}
+	}
 
 	/*
 	 * Return bishop attacks.
 	 */
 	Bitboard get_bishop_attacks(Bitboard occupancy, int square) {
-		occupancy &= bishop_magic_table[square].mask;
-		occupancy *= bishop_magic_table[square].magic_number;
-		occupancy >>= 55;
-		return bishop_attacks[occupancy][square];
+		return bishop_attacks[get_bishop_index(occupancy, square)];
 	}
 
 	/*
 	 * Return rook attacks.
 	 */
 	Bitboard get_rook_attacks(Bitboard occupancy, int square) {
-		occupancy &= rook_magic_table[square].mask;
-		occupancy *= rook_magic_table[square].magic_number;
-		occupancy >>= 52;
-		return rook_attacks[occupancy][square];
+		return rook_attacks[get_rook_index(occupancy, square)];
 	}
 
 	/*
@@ -27,14 +27,18 @@
 #ifndef SRC_ATTACKS_H_
 #define SRC_ATTACKS_H_
 
+#if defined(__GNUC__) && defined(__x86_64__)
+#define PEXT_BACKEND
+#endif
+
 namespace Attacks {
 
 	/*
 	 * Attack tables for non sliding pieces.
 	 */
-	extern Bitboard knight_attacks[SQUARES];
-	extern Bitboard pawn_attacks[PLAYERS][SQUARES];
-	extern Bitboard king_attacks[SQUARES];
+	extern const Square_bitboards knight_attacks;
+	extern const std::array<Square_bitboards, PLAYERS> pawn_attacks;
+	extern const Square_bitboards king_attacks;
 	extern Bitboard king_castling[PLAYERS][SQUARES];
 
 	/*
@@ -43,29 +47,73 @@ namespace Attacks {
 	struct Magic {
 		Bitboard mask;
 		Bitboard magic_number;
+		unsigned int offset; // First entry of the square in the attack tables
+		unsigned int shift;
 	};
 
 	/*
 	 * Magic multipliers for bishops and rooks.
 	 */
-	extern Magic bishop_magic_table[SQUARES];
-	extern Magic rook_magic_table[SQUARES];
+	extern const std::array<Magic, SQUARES> bishop_magic_table;
+	extern const std::array<Magic, SQUARES> rook_magic_table;
 
 	/*
-	 * Attack tables for sliding pieces.
+	 * Attack tables for sliding pieces. The entries of all squares
+	 * are packed together, each square only takes as many as
+	 * its mask needs (2^bits).
 	 */
-	extern Bitboard bishop_attacks[512][SQUARES]; // 256 KB
-	extern Bitboard rook_attacks[4096][SQUARES]; // 2MB
+	const int BISHOP_TABLE_SIZE = 5248;
+	const int ROOK_TABLE_SIZE = 102400;
+	extern Bitboard bishop_attacks[BISHOP_TABLE_SIZE]; // 41 KB
+	extern Bitboard rook_attacks[ROOK_TABLE_SIZE]; // 800 KB
 
 	/*
 	 * Precomputed mobility for bishops and rooks (also used for queens)
 	 */
-	extern int bishop_mobility[512][SQUARES];
-	extern int rook_mobility[4096][SQUARES];
+	extern unsigned char bishop_mobility[BISHOP_TABLE_SIZE];
+	extern unsigned char rook_mobility[ROOK_TABLE_SIZE];
 
 	// Initialization
 	void init();
 
+	/*
+	 * Sliding attacks backend, chosen at startup with cpuid:
+	 * PEXT when the CPU supports BMI2, magic multiplication otherwise.
+	 */
+	extern bool use_pext;
+
+	/*
+	 * Parallel bit extract. Written in assembly so it can be inlined
+	 * without building the whole engine for BMI2; only reached
+	 * when use_pext is set.
+	 */
+	inline Bitboard pext(Bitboard occupancy, Bitboard mask) {
+#ifdef PEXT_BACKEND
+		Bitboard result;
+		__asm__("pextq %2, %1, %0" : "=r" (result) : "r" (occupancy), "rm" (mask));
+		return result;
+#else
+		return occupancy & mask;
+#endif
+	}
+
+	/*
+	 * Index of the occupancy in the attack and mobility tables.
+	 */
+	inline unsigned int get_magic_index(const Magic& magic, Bitboard occupancy) {
+		if (use_pext)
+			return magic.offset + pext(occupancy, magic.mask);
+		return magic.offset + (((occupancy & magic.mask) * magic.magic_number) >> magic.shift);
+	}
+
+	inline unsigned int get_bishop_index(Bitboard occupancy, int square) {
+		return get_magic_index(bishop_magic_table[square], occupancy);
+	}
+
+	inline unsigned int get_rook_index(Bitboard occupancy, int square) {
+		return get_magic_index(rook_magic_table[square], occupancy);
+	}
+
 	/*
 	 * Return queen attacks.
 	 */
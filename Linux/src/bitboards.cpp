@@ -24,173 +24,125 @@
 
 namespace Bitboards {
 
-	void init_bit_masks();
-	void init_files_bb();
-	void init_ranks_bb();
-	void init_passed_pawn_masks();
+	/*
+	 * Bitboard fills.
+	 */
+	constexpr Bitboard north_fill(Bitboard b) {
+	   b |= (b <<  8);
+	   b |= (b << 16);
+	   b |= (b << 32);
+	   return b;
+	}
+
+	constexpr Bitboard south_fill(Bitboard b) {
+	   b |= (b >>  8);
+	   b |= (b >> 16);
+	   b |= (b >> 32);
+	   return b;
+	}
 
 	/*
-	 * Initialization.
+	 * Bitboard spans.
 	 */
-	void init() {
-		init_bit_masks();
-		init_files_bb();
-		init_ranks_bb();
-		init_passed_pawn_masks();
+	constexpr Bitboard white_front_span(Bitboard white_pawns) {
+		return shift<NORTH>(north_fill(white_pawns));
+	}
+	constexpr Bitboard black_front_span(Bitboard black_pawns) {
+		return shift<SOUTH>(south_fill(black_pawns));
 	}
 
 	/*
-	 * Masks to set and clear bits.
+	 * All the tables below are computed at compile time.
 	 */
-	Bitboard set_bit_masks[SQUARES];
-	Bitboard clear_bit_masks[SQUARES];
 
-	void init_bit_masks() {
-		Bitboard one = 1;
-		for (int i = 0; i < 64; i++) {
-			set_bit_masks[i] = one << i;
-			clear_bit_masks[i] = ~set_bit_masks[i];
-		}
+	/*
+	 * Masks to set and clear bits.
+	 */
+	constexpr Square_bitboards init_set_bit_masks() {
+		Square_bitboards masks = {};
+		for (int i = 0; i < 64; i++)
+			masks[i] = Bitboard(1) << i;
+		return masks;
 	}
 
+	constexpr Square_bitboards set_bit_masks = init_set_bit_masks();
+
 	/*
 	 * Files and ranks bitboards.
 	 */
-	Bitboard files_bb[FILES];
-	Bitboard ranks_bb[RANKS];
-
-	void init_files_bb() {
+	constexpr std::array<Bitboard, FILES> init_files_bb() {
+		std::array<Bitboard, FILES> files = {};
 		Bitboard file_bitboard = 0x0101010101010101;
 		for (int file = FILE_A; file <= FILE_H; file++) {
-			files_bb[file] = file_bitboard;
+			files[file] = file_bitboard;
 			file_bitboard <<= 1;
 		}
+		return files;
 	}
 
-	void init_ranks_bb() {
+	constexpr std::array<Bitboard, RANKS> init_ranks_bb() {
+		std::array<Bitboard, RANKS> ranks = {};
 		Bitboard rank_bitboard = 0x00000000000000FF;
 		for (int rank = RANK_1; rank <= RANK_8; rank++) {
-			ranks_bb[rank] = rank_bitboard;
+			ranks[rank] = rank_bitboard;
 			rank_bitboard <<= 8;
 		}
+		return ranks;
 	}
 
+	constexpr std::array<Bitboard, FILES> files_bb = init_files_bb();
+	constexpr std::array<Bitboard, RANKS> ranks_bb = init_ranks_bb();
+
 	/*
 	 * Masks to evaluate passed pawns.
 	 */
-	Bitboard passed_pawn_mask[PLAYERS][SQUARES];
-
-	// Bitboard spans
-	Bitboard white_front_span(Bitboard white_pawns);
-	Bitboard black_front_span(Bitboard black_pawns);
-	// Bitboard shifting
-	Bitboard north_one (Bitboard b);
-	Bitboard south_one (Bitboard b);
-	Bitboard east_one (Bitboard b);
-	Bitboard west_one (Bitboard b);
-
-	void init_passed_pawn_masks() {
+	constexpr std::array<Square_bitboards, PLAYERS> init_passed_pawn_masks() {
+		std::array<Square_bitboards, PLAYERS> masks = {};
 		for (int square = A1; square <= H8; square++) {
-			Bitboard square_bitboard = 0;
-			set_bit(square_bitboard, square);
-			passed_pawn_mask[WHITE][square] = 	east_one(white_front_span(square_bitboard)) |
-												west_one(white_front_span(square_bitboard)) |
-												white_front_span(square_bitboard);
-			passed_pawn_mask[BLACK][square] = 	east_one(black_front_span(square_bitboard)) |
-												west_one(black_front_span(square_bitboard)) |
-												black_front_span(square_bitboard);
+			Bitboard square_bitboard = set_bit_masks[square];
+			masks[WHITE][square] = 	shift<EAST>(white_front_span(square_bitboard)) |
+									shift<WEST>(white_front_span(square_bitboard)) |
+									white_front_span(square_bitboard);
+			masks[BLACK][square] = 	shift<EAST>(black_front_span(square_bitboard)) |
+									shift<WEST>(black_front_span(square_bitboard)) |
+									black_front_span(square_bitboard);
 		}
+		return masks;
 	}
 
-	/*
-	 * Bitboard shifting.
-	 */
-	Bitboard north_one (Bitboard b) {
-		return  b << 8;
-	}
-	Bitboard south_one (Bitboard b) {
-		return  b >> 8;
-	}
-	Bitboard east_one (Bitboard b) {
-		return (b << 1) & not_A_file;
-	}
-	Bitboard west_one (Bitboard b) {
-		return (b >> 1) & not_H_file;
-	}
-
-	// Fills
-	Bitboard north_fill(Bitboard b);
-	Bitboard south_fill(Bitboard b);
+	constexpr std::array<Square_bitboards, PLAYERS> passed_pawn_mask = init_passed_pawn_masks();
 
 	/*
-	 * Bitboard spans.
+	 * Lines and squares between aligned squares.
 	 */
-	Bitboard white_front_span(Bitboard white_pawns) {
-		return north_one(north_fill(white_pawns));
-	}
-	Bitboard black_front_span(Bitboard black_pawns) {
-		return south_one(south_fill(black_pawns));
-	}
-
-	/*
-	 * Bitboard fills.
-	 */
-	Bitboard north_fill(Bitboard b) {
-	   b |= (b <<  8);
-	   b |= (b << 16);
-	   b |= (b << 32);
-	   return b;
-	}
-
-	Bitboard south_fill(Bitboard b) {
-	   b |= (b >>  8);
-	   b |= (b >> 16);
-	   b |= (b >> 32);
-	   return b;
-	}
-
-	/*
-	 * Bitscan.
-	 */
-	const int index64_forward[64] = {
-		0,  1, 48,  2, 57, 49, 28,  3,
-	   61, 58, 50, 42, 38, 29, 17,  4,
-	   62, 55, 59, 36, 53, 51, 43, 22,
-	   45, 39, 33, 30, 24, 18, 12,  5,
-	   63, 47, 56, 27, 60, 41, 37, 16,
-	   54, 35, 52, 21, 44, 32, 23, 11,
-	   46, 26, 40, 15, 34, 20, 31, 10,
-	   25, 14, 19,  9, 13,  8,  7,  6
-	};
-
-	int bit_scan_forward(Bitboard bitboard) {
-		const Bitboard debruijn64 = 0x03f79d71b4cb0a89;
-		return index64_forward[((bitboard & -bitboard) * debruijn64) >> 58];
-	}
-
-	/*
-	 * Population count.
-	 */
-	int population_count(Bitboard bitboard) {
-		int count = 0;
-		while(bitboard) {
-			count++;
-			bitboard &= bitboard - 1;
+	constexpr std::array<Square_bitboards, SQUARES> init_lines(bool between_squares) {
+		std::array<Square_bitboards, SQUARES> lines = {};
+		const int file_steps[8] = {1, -1, 0, 0, 1, -1, 1, -1};
+		const int rank_steps[8] = {0, 0, 1, -1, 1, -1, -1, 1}; // opposite directions in pairs
+		for (int square = A1; square <= H8; square++) {
+			for (int direction = 0; direction < 8; direction++) {
+				// Full ray in both directions
+				Bitboard line = set_bit_masks[square];
+				for (int side = 0; side < 2; side++) {
+					int d = direction ^ side;
+					int file = (square & 7) + file_steps[d];
+					int rank = (square >> 3) + rank_steps[d];
+					for (; file >= 0 && file < 8 && rank >= 0 && rank < 8; file += file_steps[d], rank += rank_steps[d])
+						line |= set_bit_masks[rank * 8 + file];
+				}
+				// Squares along the ray
+				Bitboard between = 0;
+				int file = (square & 7) + file_steps[direction];
+				int rank = (square >> 3) + rank_steps[direction];
+				for (; file >= 0 && file < 8 && rank >= 0 && rank < 8; file += file_steps[direction], rank += rank_steps[direction]) {
+					lines[square][rank * 8 + file] = between_squares ? between : line;
+					between |= set_bit_masks[rank * 8 + file];
+				}
+			}
 		}
-		return count;
-	}
-
-	/*
-	 * Set bits.
-	 */
-	void set_bit(Bitboard &bitboard, int i) {
-		bitboard = bitboard | set_bit_masks[i];
+		return lines;
 	}
 
-	/*
-	 * Clear bits.
-	 */
-	void clear_bit(Bitboard &bitboard, int i) {
-		bitboard = bitboard & clear_bit_masks[i];
-	}
+	constexpr std::array<Square_bitboards, SQUARES> between_bb = init_lines(true);
+	constexpr std::array<Square_bitboards, SQUARES> line_bb = init_lines(false);
 }
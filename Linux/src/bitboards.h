@@ -23,35 +23,128 @@
 #ifndef SRC_BITBOARDS_H_
 #define SRC_BITBOARDS_H_
 
+#include <array>
+
 #include "types.h"
 
 // Bitboard type
 typedef unsigned long long Bitboard;
 
+// One bitboard per square
+typedef std::array<Bitboard, SQUARES> Square_bitboards;
+
 namespace Bitboards {
 
-	// Initialization
-	void init();
+	// Data
+	extern const std::array<Bitboard, FILES> files_bb;
+	extern const std::array<Bitboard, RANKS> ranks_bb;
+	constexpr Bitboard not_A_file = 0xfefefefefefefefe;
+	constexpr Bitboard not_H_file = 0x7f7f7f7f7f7f7f7f;
+	constexpr Bitboard not_8_rank = 0x00FFFFFFFFFFFFFF;
+	constexpr Bitboard not_1_rank = 0xFFFFFFFFFFFFFF00;
+
+	/*
+	 * Bitboard primitives. They are defined here so they can be inlined
+	 * in the move generator and evaluation loops. With GCC or Clang they
+	 * map to the compiler builtins, which become popcnt/tzcnt/lzcnt
+	 * when the target has them (-mpopcnt, -mbmi, -march=native...).
+	 * The portable versions are used otherwise.
+	 */
 
 	// Bitboard manipulation
-	void set_bit(Bitboard &bitboard, int i);
-	void clear_bit(Bitboard &bitboard, int i);
+	constexpr void set_bit(Bitboard &bitboard, int i) {
+		bitboard |= 1ULL << i;
+	}
 
-	// Bitboard info
-	int bit_scan_forward(Bitboard bitboard);
-	int population_count(Bitboard bitboard);
+	constexpr void clear_bit(Bitboard &bitboard, int i) {
+		bitboard &= ~(1ULL << i);
+	}
+
+	/*
+	 * Population count.
+	 */
+	constexpr int population_count(Bitboard bitboard) {
+#if defined(__GNUC__) && defined(__POPCNT__)
+		return __builtin_popcountll(bitboard);
+#else
+		// Without popcnt the builtin is a library call, SWAR is faster
+		bitboard = bitboard - ((bitboard >> 1) & 0x5555555555555555ULL);
+		bitboard = (bitboard & 0x3333333333333333ULL) + ((bitboard >> 2) & 0x3333333333333333ULL);
+		bitboard = (bitboard + (bitboard >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+		return (bitboard * 0x0101010101010101ULL) >> 56;
+#endif
+	}
+
+	/*
+	 * Index of the least significant bit. The bitboard can't be empty.
+	 */
+	constexpr int bit_scan_forward(Bitboard bitboard) {
+#if defined(__GNUC__)
+		return __builtin_ctzll(bitboard);
+#else
+		constexpr int index64[64] = {
+			0,  1, 48,  2, 57, 49, 28,  3,
+		   61, 58, 50, 42, 38, 29, 17,  4,
+		   62, 55, 59, 36, 53, 51, 43, 22,
+		   45, 39, 33, 30, 24, 18, 12,  5,
+		   63, 47, 56, 27, 60, 41, 37, 16,
+		   54, 35, 52, 21, 44, 32, 23, 11,
+		   46, 26, 40, 15, 34, 20, 31, 10,
+		   25, 14, 19,  9, 13,  8,  7,  6
+		};
+		return index64[((bitboard & -bitboard) * 0x03f79d71b4cb0a89ULL) >> 58];
+#endif
+	}
+
+	/*
+	 * Index of the most significant bit. The bitboard can't be empty.
+	 */
+	constexpr int bit_scan_reverse(Bitboard bitboard) {
+#if defined(__GNUC__)
+		return 63 ^ __builtin_clzll(bitboard);
+#else
+		int index = 0;
+		while (bitboard >>= 1)
+			index++;
+		return index;
+#endif
+	}
+
+	/*
+	 * Returns the index of the least significant bit and clears it.
+	 */
+	constexpr int pop_lsb(Bitboard &bitboard) {
+		int index = bit_scan_forward(bitboard);
+		bitboard &= bitboard - 1;
+		return index;
+	}
+
+	/*
+	 * Moves all the bits one step in a direction,
+	 * dropping the ones that would wrap around the board.
+	 */
+	template<Direction D>
+	constexpr Bitboard shift(Bitboard b) {
+		return 	D == NORTH ? b << 8 :
+				D == SOUTH ? b >> 8 :
+				D == EAST ? (b << 1) & not_A_file :
+				D == WEST ? (b >> 1) & not_H_file :
+				D == NORTH_WEST ? (b << 7) & not_H_file :
+				D == NORTH_EAST ? (b << 9) & not_A_file :
+				D == SOUTH_WEST ? (b >> 9) & not_H_file :
+				D == SOUTH_EAST ? (b >> 7) & not_A_file : 0;
+	}
 
-	// Data
-	extern Bitboard files_bb[FILES];
-	extern Bitboard ranks_bb[RANKS];
-	const Bitboard not_A_file = 0xfefefefefefefefe;
-	const Bitboard not_H_file = 0x7f7f7f7f7f7f7f7f;
-	const Bitboard not_8_rank = 0x00FFFFFFFFFFFFFF;
-	const Bitboard not_1_rank = 0xFFFFFFFFFFFFFF00;
 	/*
 	 * Masks to evaluate passed pawns.
 	 */
-	extern Bitboard passed_pawn_mask[PLAYERS][SQUARES];
+	extern const std::array<Square_bitboards, PLAYERS> passed_pawn_mask;
+	/*
+	 * Squares strictly between two aligned squares, and the whole
+	 * line (rank, file or diagonal) through them. Empty if not aligned.
+	 */
+	extern const std::array<Square_bitboards, SQUARES> between_bb;
+	extern const std::array<Square_bitboards, SQUARES> line_bb;
 }
 
 #endif /* SRC_BITBOARDS_H_ */
@@ -96,7 +96,7 @@ namespace Evaluation {
 	/*
 	 * Pawns value depending on the square.
 	 */
-	const int pawn_table[SQUARES] = {
+	constexpr int pawn_table[SQUARES] = {
 			 0,  0,  0,  0,  0,  0,  0,  0,
 			 5, 10, 10,-20,-20, 10, 10,  5,
 			 5, -5,-10,  0,  0,-15, -5,  5,
@@ -110,7 +110,7 @@ namespace Evaluation {
 	/*
 	 * Knights value depending on the square.
 	 */
-	const int knight_table[SQUARES] = {
+	constexpr int knight_table[SQUARES] = {
 			-50,-40,-30,-30,-30,-30,-40,-50,
 			-40,-20,  0,  5,  5,  0,-20,-40,
 			-30,  5, 10, 15, 15, 10,  5,-30,
@@ -124,7 +124,7 @@ namespace Evaluation {
 	/*
 	 * Bishops value depending on the square.
 	 */
-	const int bishop_table[SQUARES] = {
+	constexpr int bishop_table[SQUARES] = {
 			-20,-10,-10,-10,-10,-10,-10,-20,
 			-10,  5,  0,  0,  0,  0,  5,-10,
 			-10, 10, 10, 10, 10, 10, 10,-10,
@@ -138,7 +138,7 @@ namespace Evaluation {
 	/*
 	 * Rooks value depending on the square.
 	 */
-	const int rook_table[SQUARES] = {
+	constexpr int rook_table[SQUARES] = {
 			  0,  0,  5,  10, 10, 5,  0,  0,
 			 -5,  0,  0,  0,  0,  0,  0, -5,
 			 -5,  0,  0,  0,  0,  0,  0, -5,
@@ -152,7 +152,7 @@ namespace Evaluation {
 	/*
 	 * Queens value depending on the square.
 	 */
-	const int queen_table[SQUARES] = {
+	constexpr int queen_table[SQUARES] = {
 			-20,-10,-10, -5, -5,-10,-10,-20,
 			-10,  0,  5,  0,  0,  0,  0,-10,
 			-10,  5,  5,  5,  5,  5,  0,-10,
@@ -166,7 +166,7 @@ namespace Evaluation {
 	/*
 	 * King value in the middlegame depending on the square.
 	 */
-	const int king_table_middlegame[SQUARES] = {
+	constexpr int king_table_middlegame[SQUARES] = {
 			 15, 30, 10,  -5,  -5, 10, 40, 15,
 			 20, 20,  0, -10, -10,  0, 20, 20,
 			-10,-20,-20, -20, -20,-20,-20,-10,
@@ -180,7 +180,7 @@ namespace Evaluation {
 	/*
 	 * King value in the endgame depending on the square.
 	 */
-	const int king_table_endgame[SQUARES] = {
+	constexpr int king_table_endgame[SQUARES] = {
 			-50,-30,-30,-30,-30,-30,-30,-50,
 			-30,-20,  0,  0,  0,  0,-20,-30,
 			-30,-10, 20, 30, 30, 20,-10,-30,
@@ -195,7 +195,7 @@ namespace Evaluation {
 	 * Mirror square table to apply the same
 	 * piece tables for black.
 	 */
-	const int mirror_square[SQUARES] = {
+	constexpr int mirror_square[SQUARES] = {
 			56, 57, 58, 59, 60, 61, 62, 63,
 			48, 49, 50, 51, 52, 53, 54, 55,
 			40, 41, 42, 43, 44, 45, 46, 47,
@@ -209,7 +209,7 @@ namespace Evaluation {
 	/*
 	 * Returns the pawn structure score.
 	 */
-	void compute_pawns_info(Position &pos, Pawns_info &pawns_info);
+	void compute_pawns_info(Position &pos, Pawn_hash_table &pawns_hash_table, Pawns_info &pawns_info);
 
 	/*
 	 * Returns true if the material left on the board is
@@ -246,20 +246,41 @@ namespace Evaluation {
 	}
 
 	/*
-	 * Returns a piece value depending of the location
-	 * on the board.
+	 * Builds the packed piece-square table. Only the king has
+	 * different middlegame and endgame bonuses.
 	 */
-	int get_piece_value(int piece, int square, Color side) {
-		square = side == WHITE ? square : mirror_square[square];
-		switch(piece) {
-		case(KNIGHT) : return knight_table[square] + knight_value; break;
-		case(BISHOP) : return bishop_table[square] + bishop_value; break;
-		case(ROOK) : return rook_table[square] + rook_value; break;
-		case(QUEEN) : return queen_table[square] + queen_value; break;
-		case(PAWN) : return pawn_table[square] + pawn_value; break;
-		case(KING) : return king_value; break;
-		default: return 0;
+	constexpr std::array<Piece_square_scores, PLAYERS> init_psq_table() {
+		std::array<Piece_square_scores, PLAYERS> table = {};
+		for (int side = WHITE; side <= BLACK; side++) {
+			for (int square = A1; square <= H8; square++) {
+				int relative_square = side == WHITE ? square : mirror_square[square];
+				table[side][KNIGHT][square] = make_score(knight_value + knight_table[relative_square], knight_value + knight_table[relative_square]);
+				table[side][BISHOP][square] = make_score(bishop_value + bishop_table[relative_square], bishop_value + bishop_table[relative_square]);
+				table[side][ROOK][square] = make_score(rook_value + rook_table[relative_square], rook_value + rook_table[relative_square]);
+				table[side][QUEEN][square] = make_score(queen_value + queen_table[relative_square], queen_value + queen_table[relative_square]);
+				table[side][PAWN][square] = make_score(pawn_value + pawn_table[relative_square], pawn_value + pawn_table[relative_square]);
+				table[side][KING][square] = make_score(king_value + king_table_middlegame[relative_square], king_value + king_table_endgame[relative_square]);
+			}
 		}
+		return table;
+	}
+
+	constexpr std::array<Piece_square_scores, PLAYERS> psq_table = init_psq_table();
+
+	/*
+	 * Returns the percentage of the middlegame in the game
+	 * phase, based on the material left on the board.
+	 */
+	inline int get_middlegame_percentage(Position &pos) {
+		int position_material = pos.get_material(WHITE) + pos.get_material(BLACK) - 2 * king_value;
+		return (position_material * 100) / initial_material;
+	}
+
+	/*
+	 * Interpolates the middlegame and endgame values of a score.
+	 */
+	inline int taper(Score score, int middlegame_percentage) {
+		return (middlegame_value(score) * middlegame_percentage + endgame_value(score) * (100 - middlegame_percentage)) / 100;
 	}
 
 	/*
@@ -276,8 +297,9 @@ namespace Evaluation {
 	int evaluate_material(Position &pos) {
 		// Set the material score for a player to 0 if it has a piece
 		// combination that's not enough for giving mate.
-		int score = pos.get_material(WHITE) * mating_material(pos, WHITE) -
-					pos.get_material(BLACK) * mating_material(pos, BLACK);
+		int middlegame_percentage = get_middlegame_percentage(pos);
+		int score = taper(pos.get_psq_score(WHITE), middlegame_percentage) * mating_material(pos, WHITE) -
+					taper(pos.get_psq_score(BLACK), middlegame_percentage) * mating_material(pos, BLACK);
 		// Side to move point of view.
 		return adjust_score_sign(pos, score);
 	}
@@ -340,7 +362,7 @@ namespace Evaluation {
 	/*
 	 * Returns the positional evaluation score.
 	 */
-	int evaluate_positional_factors(Position &pos) {
+	int evaluate_positional_factors(Position &pos, Pawn_hash_table &pawns_hash_table) {
 		/*
 		 * TODO: this is a really long function and there's
 		 * duplicated code... I should add auxiliary functions
@@ -349,16 +371,15 @@ namespace Evaluation {
 
 		// Computes the game phase based on the material left on the board.
 		// ***********************************************************
-		int position_material = pos.get_material(WHITE) + pos.get_material(BLACK) - 2 * king_value;
-		int middlegame_percentage = (position_material * 100) / initial_material;
+		int middlegame_percentage = get_middlegame_percentage(pos);
 		int endgame_percentage = 100 - middlegame_percentage;
 		// ***********************************************************
 
 		// Pawns info
 		// ***********************************************************
 		Pawns_info pawns_info;
-		if (!probe_hash_pawns(pos.get_pawns_key(), pawns_info)) {
-			compute_pawns_info(pos, pawns_info);
+		if (!probe_hash_pawns(pawns_hash_table, pos.get_pawns_key(), pawns_info)) {
+			compute_pawns_info(pos, pawns_hash_table, pawns_info);
 		}
 		// ***********************************************************
 
@@ -391,11 +412,8 @@ namespace Evaluation {
 		while(white_bishops) {
 			bishops++;
 			int bishop_index = Bitboards::bit_scan_forward(white_bishops);
-			Bitboard occupancy = pos.get_occupancy();
-			occupancy &= bishop_magic_table[bishop_index].mask;
-			occupancy *= bishop_magic_table[bishop_index].magic_number;
-			occupancy >>= 55;
-			piece_mobility += bishop_mobility[occupancy][bishop_index];
+			unsigned int occupancy = get_bishop_index(pos.get_occupancy(), bishop_index);
+			piece_mobility += bishop_mobility[occupancy];
 			white_bishops &= white_bishops - 1;
 		}
 		if (bishops >= 2)
@@ -406,11 +424,8 @@ namespace Evaluation {
 		while(black_bishops) {
 			bishops++;
 			int bishop_index = Bitboards::bit_scan_forward(black_bishops);
-			Bitboard occupancy = pos.get_occupancy();
-			occupancy &= bishop_magic_table[bishop_index].mask;
-			occupancy *= bishop_magic_table[bishop_index].magic_number;
-			occupancy >>= 55;
-			piece_mobility -= bishop_mobility[occupancy][bishop_index];
+			unsigned int occupancy = get_bishop_index(pos.get_occupancy(), bishop_index);
+			piece_mobility -= bishop_mobility[occupancy];
 			black_bishops &= black_bishops - 1;
 		}
 		if (bishops >= 2)
@@ -419,11 +434,8 @@ namespace Evaluation {
 		Bitboard white_rooks = pos.get_piece_bitboard(WHITE, ROOK);
 		while (white_rooks) {
 			int rook_index = Bitboards::bit_scan_forward(white_rooks);
-			Bitboard occupancy = pos.get_occupancy();
-			occupancy &= rook_magic_table[rook_index].mask;
-			occupancy *= rook_magic_table[rook_index].magic_number;
-			occupancy >>= 52;
-			piece_mobility += rook_mobility[occupancy][rook_index];
+			unsigned int occupancy = get_rook_index(pos.get_occupancy(), rook_index);
+			piece_mobility += rook_mobility[occupancy];
 			// Semi open file bonus
 			if (!(Bitboards::files_bb[rook_index & 7] & pos.get_piece_bitboard(WHITE, PAWN))) {
 				if (!(Bitboards::files_bb[rook_index & 7] & pos.get_piece_bitboard(BLACK, PAWN)))
@@ -437,11 +449,8 @@ namespace Evaluation {
 		Bitboard black_rooks = pos.get_piece_bitboard(BLACK, ROOK);
 		while (black_rooks) {
 			int rook_index = Bitboards::bit_scan_forward(black_rooks);
-			Bitboard occupancy = pos.get_occupancy();
-			occupancy &= rook_magic_table[rook_index].mask;
-			occupancy *= rook_magic_table[rook_index].magic_number;
-			occupancy >>= 52;
-			piece_mobility -= rook_mobility[occupancy][rook_index];
+			unsigned int occupancy = get_rook_index(pos.get_occupancy(), rook_index);
+			piece_mobility -= rook_mobility[occupancy];
 			// Semi open file bonus
 			if (!(Bitboards::files_bb[rook_index & 7] & pos.get_piece_bitboard(BLACK, PAWN))) {
 				if (!(Bitboards::files_bb[rook_index & 7] & pos.get_piece_bitboard(WHITE, PAWN)))
@@ -457,19 +466,13 @@ namespace Evaluation {
 		while (white_queens) {
 			int queen_index = Bitboards::bit_scan_forward(white_queens);
 
-			Bitboard occupancy = pos.get_occupancy();
-			occupancy &= rook_magic_table[queen_index].mask;
-			occupancy *= rook_magic_table[queen_index].magic_number;
-			occupancy >>= 52;
-			piece_mobility += rook_mobility[occupancy][queen_index];
-			white_queens_attacks |= rook_attacks[occupancy][queen_index];
+			unsigned int occupancy = get_rook_index(pos.get_occupancy(), queen_index);
+			piece_mobility += rook_mobility[occupancy];
+			white_queens_attacks |= rook_attacks[occupancy];
 
-			occupancy = pos.get_occupancy();
-			occupancy &= bishop_magic_table[queen_index].mask;
-			occupancy *= bishop_magic_table[queen_index].magic_number;
-			occupancy >>= 55;
-			piece_mobility += bishop_mobility[occupancy][queen_index];
-			white_queens_attacks |= bishop_attacks[occupancy][queen_index];
+			occupancy = get_bishop_index(pos.get_occupancy(), queen_index);
+			piece_mobility += bishop_mobility[occupancy];
+			white_queens_attacks |= bishop_attacks[occupancy];
 
 			white_queens &= white_queens - 1;
 		}
@@ -479,19 +482,13 @@ namespace Evaluation {
 		while (black_queens) {
 			int queen_index = Bitboards::bit_scan_forward(black_queens);
 
-			Bitboard occupancy = pos.get_occupancy();
-			occupancy &= rook_magic_table[queen_index].mask;
-			occupancy *= rook_magic_table[queen_index].magic_number;
-			occupancy >>= 52;
-			piece_mobility -= rook_mobility[occupancy][queen_index];
-			black_queens_attacks |= rook_attacks[occupancy][queen_index];
+			unsigned int occupancy = get_rook_index(pos.get_occupancy(), queen_index);
+			piece_mobility -= rook_mobility[occupancy];
+			black_queens_attacks |= rook_attacks[occupancy];
 
-			occupancy = pos.get_occupancy();
-			occupancy &= bishop_magic_table[queen_index].mask;
-			occupancy *= bishop_magic_table[queen_index].magic_number;
-			occupancy >>= 55;
-			piece_mobility -= bishop_mobility[occupancy][queen_index];
-			black_queens_attacks |= bishop_attacks[occupancy][queen_index];
+			occupancy = get_bishop_index(pos.get_occupancy(), queen_index);
+			piece_mobility -= bishop_mobility[occupancy];
+			black_queens_attacks |= bishop_attacks[occupancy];
 
 			black_queens &= black_queens - 1;
 		}
@@ -531,13 +528,10 @@ namespace Evaluation {
 		}
 		// ***********************************************************
 
-		// King position
+		// King position, the piece-square bonus is in the material score
 		// ***********************************************************
 		int white_king_square = Bitboards::bit_scan_forward(pos.get_piece_bitboard(WHITE, KING));
 		int black_king_square = Bitboards::bit_scan_forward(pos.get_piece_bitboard(BLACK, KING));
-
-		int king_middlegame_score = king_table_middlegame[white_king_square] - king_table_middlegame[mirror_square[black_king_square]];
-		int king_endgame_score = king_table_endgame[white_king_square] - king_table_endgame[mirror_square[black_king_square]];
 		// ***********************************************************
 
 		// King safety
@@ -563,7 +557,7 @@ namespace Evaluation {
 		if (king_attacks[black_king_square] & white_queens_attacks)
 			king_safety += king_zone_attacked;
 
-		score += ((king_middlegame_score + king_safety) * middlegame_percentage + king_endgame_score * endgame_percentage) / 100;
+		score += (king_safety * middlegame_percentage) / 100;
 		// ***********************************************************
 
 		// Side to move point of view.
@@ -573,7 +567,7 @@ namespace Evaluation {
 	/*
 	 * Returns the pawn structure score for a certain side.
 	 */
-	void compute_pawns_info(Position &pos, Pawns_info &pawns_info) {
+	void compute_pawns_info(Position &pos, Pawn_hash_table &pawns_hash_table, Pawns_info &pawns_info) {
 		/*
 		 * TODO: this is a really long function and there's
 		 * duplicated code... I should add auxiliary functions
@@ -835,6 +829,6 @@ namespace Evaluation {
 		pawns_info.king_wing_safety[BLACK] = black_king_wing_safety;
 		pawns_info.queen_wing_safety[WHITE] = white_queen_wing_safety;
 		pawns_info.queen_wing_safety[BLACK] = black_queen_wing_safety;
-		store_hash_pawns(pos.get_pawns_key(), pawns_info);
+		store_hash_pawns(pawns_hash_table, pos.get_pawns_key(), pawns_info);
 	}
 }
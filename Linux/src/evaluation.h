@@ -23,8 +23,11 @@
 #ifndef SRC_EVALUATION_H_
 #define SRC_EVALUATION_H_
 
+#include <array>
+
 #include "types.h"
 #include "position.h"
+#include "pawnhashtable.h"
 
 namespace Evaluation {
 
@@ -38,10 +41,11 @@ namespace Evaluation {
 	 * A positive score represents the side to move has advantage
 	 * and a negative score represents the same for the other player.
 	 */
-	int evaluate_positional_factors(Position &pos);
+	int evaluate_positional_factors(Position &pos, Pawn_hash_table &pawns_hash_table);
 
 	/*
-	 * Returns the material and piece location score.
+	 * Returns the material and piece location score,
+	 * interpolated between middlegame and endgame.
 	 * A positive score represents the side to move has advantage
 	 * and a negative score represents the same for the other player.
 	 */
@@ -53,10 +57,12 @@ namespace Evaluation {
 	int get_piece_value(int piece);
 
 	/*
-	 * Return the material value of a piece depending on the location
-	 * of the piece on the board.
+	 * Material value plus piece-square bonus, as middlegame and endgame
+	 * scores, for each side, piece type and square. Position keeps
+	 * the sum for each side updated while making moves.
 	 */
-	int get_piece_value(int piece, int square, Color side);
+	typedef std::array<std::array<Score, SQUARES>, PIECE_TYPES / PLAYERS> Piece_square_scores;
+	extern const std::array<Piece_square_scores, PLAYERS> psq_table;
 
 	/*
 	 * Returns true if there's insufficient material on the board.
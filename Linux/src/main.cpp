@@ -27,18 +27,14 @@
 #include "attacks.h"
 #include "uci.h"
 #include "transpositiontable.h"
-#include "pawnhashtable.h"
 
 using namespace std;
 
 int main() {
 
 	// Initialization
-	Position::init();
-	Bitboards::init();
 	Attacks::init();
 	Search::init();
-	Evaluation::init();
 
 	// LICENSE
 	cout << "**************************************************************" << endl;
@@ -41,416 +41,403 @@ namespace MoveGen {
 	int capture_score = 2048;
 	int promotion_score = 3000;
 
-	// Generate all moves
-	void generate_knight_moves(Position &pos, Move_list &move_list);
-	void generate_king_moves(Position &pos, Move_list &move_list);
-	void generate_bishop_moves(Position &pos, Move_list &move_list);
-	void generate_rook_moves(Position &pos, Move_list &move_list);
-	void generate_queen_moves(Position &pos, Move_list &move_list);
-
-	// Pawn moves
-	void generate_pawn_moves(Position &pos, Move_list &move_list);
-	void generate_white_pawns_moves(Position &pos, Move_list &move_list);
-	void generate_black_pawns_moves(Position &pos, Move_list &move_list);
-
-	// Captures
-	void generate_knight_captures(Position &pos, Move_list &move_list);
-	void generate_king_captures(Position &pos, Move_list &move_list);
-	void generate_bishop_captures(Position &pos, Move_list &move_list);
-	void generate_rook_captures(Position &pos, Move_list &move_list);
-	void generate_queen_captures(Position &pos, Move_list &move_list);
-
-	// Pawn captures
-	void generate_pawn_captures(Position &pos, Move_list &move_list);
-	void generate_white_pawns_captures(Position &pos, Move_list &move_list);
-	void generate_black_pawns_captures(Position &pos, Move_list &move_list);
-
-	// Promotions
-	void generate_promotions(Position &pos, Move_list &move_list);
-	void generate_white_promotions(Position &pos, Move_list &move_list);
-	void generate_black_promotions(Position &pos, Move_list &move_list);
+	/*
+	 * Kind of moves to generate. Every generator is instantiated
+	 * for each side and type, so the side to move and the targets
+	 * are known at compile time.
+	 */
+	enum Gen_type {
+		ALL,
+		CAPTURES, // captures and capture promotions
+		QUIETS, // neither captures nor promotions
+		PROMOTIONS, // promotions without capture
+		EVASIONS // all moves when in check
+	};
+
+	/*
+	 * Legality info computed once per generation.
+	 * A move of a piece other than the king must land on the check mask
+	 * (every square when not in check, the checker or a square between
+	 * it and the king in single check, none in double check).
+	 * Pinned pieces can only move along the line of the pin.
+	 */
+	struct Legal_masks {
+		int king_square;
+		Bitboard pinned;
+		Bitboard check_mask;
+	};
+
+	/*
+	 * Rank relative to the side: RANK_1 is the first rank of the side.
+	 */
+	constexpr Bitboard relative_rank_bb(Color side, Rank rank) {
+		return 0xFFULL << (8 * (side == WHITE ? rank : RANK_8 - rank));
+	}
+
+	// Legality
+	template<Color Us> Legal_masks get_legal_masks(Position &pos);
+	Bitboard get_legal_targets(const Legal_masks &masks, int from);
+	bool pin_allows(const Legal_masks &masks, int from, int to);
+	Bitboard get_safe_king_targets(Position &pos, Bitboard targets, int king_square, Bitboard occupied, Bitboard enemies);
+
+	// Generators
+	template<Color Us, Gen_type Type> void generate(Position &pos, Move_list &move_list);
+	template<Piece_type Pt, Gen_type Type> void generate_piece_moves(Position &pos, Move_list &move_list, const Legal_masks &masks,
+			Bitboard pieces, Bitboard occupied, Bitboard enemies);
+	template<Color Us, Gen_type Type> void generate_king_moves(Position &pos, Move_list &move_list, const Legal_masks &masks,
+			Bitboard occupied, Bitboard enemies);
+	template<Color Us> void generate_castling_moves(Position &pos, Move_list &move_list, const Legal_masks &masks, Bitboard occupied);
+	template<Color Us, Gen_type Type> void generate_pawn_pushes(Position &pos, Move_list &move_list, const Legal_masks &masks, Bitboard empty_squares);
+	template<Color Us, Gen_type Type> void generate_pawn_captures(Position &pos, Move_list &move_list, const Legal_masks &masks, Bitboard enemies);
+	void generate_enpassant_captures(Position &pos, Move_list &move_list, Bitboard left_targets, Bitboard right_targets,
+			Direction left_direction, Direction right_direction);
 
 	// Extract moves
 	void extract_moves(Position &pos, Bitboard targets, int from, int move_flags, Move_list &move_list, Piece_type piece);
-	void extract_pawn_moves(Position &pos, Bitboard targets, int move_flags, Move_list &move_list, int direction);
-	void extract_pawn_captures(Position &pos, Bitboard targets, int move_flags, Move_list &move_list, Direction capture_direction);
-	void extract_pawn_push_promotions(Position &pos, Bitboard targets, Move_list &move_list, Direction direction);
-	void extract_pawn_capture_promotions(Position &pos, Bitboard targets, Move_list &move_list, Direction direction);
+	void extract_pawn_moves(Bitboard targets, int move_flags, Move_list &move_list, int direction, const Legal_masks &masks);
+	void extract_pawn_captures(Position &pos, Bitboard targets, int move_flags, Move_list &move_list, Direction capture_direction, const Legal_masks &masks);
+	void extract_pawn_push_promotions(Bitboard targets, Move_list &move_list, Direction direction, const Legal_masks &masks);
+	void extract_pawn_capture_promotions(Position &pos, Bitboard targets, Move_list &move_list, Direction direction, const Legal_masks &masks);
 
 	void add_move(Move_list &move_list, Move &move);
 
-	// Normal move generator
+	// Entry points
 	// ******************************************************************************
 	/*
-	 * Generate pseudolegal moves for this position.
+	 * Chooses the instance for the side to move.
 	 */
-	void generate_moves(Position &pos, Move_list &move_list) {
-		generate_pawn_captures(pos, move_list);
-		generate_knight_moves(pos, move_list);
-		generate_bishop_moves(pos, move_list);
-		generate_rook_moves(pos, move_list);
-		generate_queen_moves(pos, move_list);
-		generate_king_moves(pos, move_list);
-		generate_pawn_moves(pos, move_list);
+	template<Gen_type Type>
+	inline void generate_for_side_to_move(Position &pos, Move_list &move_list) {
+		if (pos.get_side_to_move() == WHITE)
+			generate<WHITE, Type>(pos, move_list);
+		else
+			generate<BLACK, Type>(pos, move_list);
 	}
 
 	/*
-	 * Generate pseudolegal knight moves for this position.
+	 * Generate legal moves for this position.
 	 */
-	void generate_knight_moves(Position &pos, Move_list &move_list) {
-		Bitboard knights = pos.get_piece_bitboard(pos.get_side_to_move(), KNIGHT);
-		while(knights) {
-			int knight_index = Bitboards::bit_scan_forward(knights);
-			Bitboard empty_targets = knight_attacks[knight_index] & pos.get_empty_squares();
-			extract_moves(pos, empty_targets, knight_index, Move::QuietMove, move_list, KNIGHT);
-			Bitboard capture_targets = knight_attacks[knight_index] & pos.get_occupied_squares(~pos.get_side_to_move());
-			extract_moves(pos, capture_targets, knight_index, Move::Capture, move_list, KNIGHT);
-			knights &= knights - 1;
-		}
+	void generate_moves(Position &pos, Move_list &move_list) {
+		generate_for_side_to_move<ALL>(pos, move_list);
 	}
 
 	/*
-	 * Generate pseudolegal king moves for this position.
+	 * Generate legal moves that are neither captures
+	 * nor promotions for this position.
 	 */
-	void generate_king_moves(Position &pos, Move_list &move_list) {
-		Bitboard empty_squares = pos.get_empty_squares();
-		Bitboard king_bb = pos.get_piece_bitboard(pos.get_side_to_move(), KING);
-		int king_index = Bitboards::bit_scan_forward(king_bb);
-		Bitboard empty_targets = king_attacks[king_index] & empty_squares;
-		extract_moves(pos, empty_targets, king_index, Move::QuietMove, move_list, KING);
-		Bitboard capture_targets = king_attacks[king_index] & pos.get_occupied_squares(~pos.get_side_to_move());
-		extract_moves(pos, capture_targets, king_index, Move::Capture, move_list, KING);
-		// Castling
-		// todo: improve castling moves generation
-		if (pos.get_side_to_move() == WHITE) {
-			if (king_index == E1) {
-				Bitboard castling_moves = 0x0000000000000044 & empty_squares;
-				Bitboard rook_castling = 0x0000000000000028 & empty_squares;
-				castling_moves &= ((rook_castling << 1) ^ (rook_castling >> 1));
-				castling_moves &= ((pos.get_piece_bitboard(pos.get_side_to_move(), ROOK) << 2) | (pos.get_piece_bitboard(pos.get_side_to_move(), ROOK) >> 1));
-				extract_moves(pos, castling_moves, king_index, Move::Castling, move_list, KING);
-			}
-		}
-		else {
-			if (king_index == E8) {
-				Bitboard castling_moves = 0x4400000000000000 & empty_squares;
-				Bitboard rook_castling = 0x2800000000000000 & empty_squares;
-				castling_moves &= ((rook_castling << 1) ^ (rook_castling >> 1));
-				castling_moves &= ((pos.get_piece_bitboard(pos.get_side_to_move(), ROOK) << 2) | (pos.get_piece_bitboard(pos.get_side_to_move(), ROOK) >> 1));
-				extract_moves(pos, castling_moves, king_index, Move::Castling, move_list, KING);
-			}
-		}
+	void generate_quiet_moves(Position &pos, Move_list &move_list) {
+		generate_for_side_to_move<QUIETS>(pos, move_list);
 	}
 
 	/*
-	 * Generate pseudolegal bishop moves for this position.
+	 * Generate legal captures for this position.
 	 */
-	void generate_bishop_moves(Position &pos, Move_list &move_list) {
-		Bitboard bishops = pos.get_piece_bitboard(pos.get_side_to_move(), BISHOP);
-		while (bishops) {
-			int bishop_index = Bitboards::bit_scan_forward(bishops);
-			Bitboard bishop_attacks = get_bishop_attacks(pos.get_occupancy(), bishop_index);
-			Bitboard empty_targets = bishop_attacks & pos.get_empty_squares();
-			extract_moves(pos, empty_targets, bishop_index, Move::QuietMove, move_list, BISHOP);
-			Bitboard capture_targets = bishop_attacks & pos.get_occupied_squares(~pos.get_side_to_move());
-			extract_moves(pos, capture_targets, bishop_index, Move::Capture, move_list, BISHOP);
-			bishops &= bishops - 1;
-		}
+	void generate_captures(Position &pos, Move_list &move_list) {
+		generate_for_side_to_move<CAPTURES>(pos, move_list);
 	}
 
 	/*
-	 * Generate pseudolegal rook moves for this position.
+	 * Generate legal promotions (without captures) for this position.
 	 */
-	void generate_rook_moves(Position &pos, Move_list &move_list) {
-		Bitboard rooks = pos.get_piece_bitboard(pos.get_side_to_move(), ROOK);
-		while (rooks) {
-			int rook_index = Bitboards::bit_scan_forward(rooks);
-			Bitboard rook_attacks = get_rook_attacks(pos.get_occupancy(), rook_index);
-			Bitboard empty_targets = rook_attacks & pos.get_empty_squares();
-			extract_moves(pos, empty_targets, rook_index, Move::QuietMove, move_list, ROOK);
-			Bitboard capture_targets = rook_attacks & pos.get_occupied_squares(~pos.get_side_to_move());
-			extract_moves(pos, capture_targets, rook_index, Move::Capture, move_list, ROOK);
-			rooks &= rooks - 1;
-		}
+	void generate_promotions(Position &pos, Move_list &move_list) {
+		generate_for_side_to_move<PROMOTIONS>(pos, move_list);
 	}
 
 	/*
-	 * Generate pseudolegal queen moves for this position.
+	 * Generate legal moves out of check: king moves to safe squares and,
+	 * in single check, captures of the checker and interpositions.
 	 */
-	void generate_queen_moves(Position &pos, Move_list &move_list) {
-		Bitboard queens = pos.get_piece_bitboard(pos.get_side_to_move(), QUEEN);
-		while (queens) {
-			int queen_index = Bitboards::bit_scan_forward(queens);
-			Bitboard queen_attacks = get_queen_attacks(pos.get_occupancy(), queen_index);
-			Bitboard empty_targets = queen_attacks & pos.get_empty_squares();
-			extract_moves(pos, empty_targets, queen_index, Move::QuietMove, move_list, QUEEN);
-			Bitboard capture_targets = queen_attacks & pos.get_occupied_squares(~pos.get_side_to_move());
-			extract_moves(pos, capture_targets, queen_index, Move::Capture, move_list, QUEEN);
-			queens &= queens - 1;
-		}
+	void generate_evasions(Position &pos, Move_list &move_list) {
+		generate_for_side_to_move<EVASIONS>(pos, move_list);
 	}
+	// ******************************************************************************
 
+	// Legality
+	// ******************************************************************************
 	/*
-	 * Generate pseudolegal pawn moves, without captures, for this position.
+	 * Gets the pinned pieces and the check mask
+	 * from the position state.
 	 */
-	void generate_pawn_moves(Position &pos, Move_list &move_list) {
-		if (pos.get_side_to_move() == WHITE)
-			generate_white_pawns_moves(pos, move_list);
+	template<Color Us>
+	Legal_masks get_legal_masks(Position &pos) {
+		Legal_masks masks;
+		masks.king_square = Bitboards::bit_scan_forward(pos.get_piece_bitboard(Us, KING));
+
+		// Checkers
+		Bitboard checkers = pos.get_checkers();
+		if (!checkers)
+			masks.check_mask = ~0ULL;
+		else if (checkers & (checkers - 1))
+			masks.check_mask = 0; // double check, only the king can move
 		else
-			generate_black_pawns_moves(pos, move_list);
+			masks.check_mask = checkers | between_bb[masks.king_square][Bitboards::bit_scan_forward(checkers)];
+
+		masks.pinned = pos.get_pinned();
+		return masks;
 	}
 
 	/*
-	 * Generate pseudolegal white pawn moves, without captures, for this position.
+	 * Squares where a piece (not the king) on the from square can legally move.
 	 */
-	void generate_white_pawns_moves(Position &pos, Move_list &move_list) {
-		Bitboard empty_squares = pos.get_empty_squares();
-		Bitboard single_push_targets = (pos.get_piece_bitboard(WHITE, PAWN) << 8) & empty_squares;
-		Bitboard double_push_targets = (single_push_targets << 8) & Bitboards::ranks_bb[RANK_4] & empty_squares;
-		Bitboard promotions = single_push_targets & Bitboards::ranks_bb[RANK_8];
-		single_push_targets &= not_8_rank;
-		extract_pawn_moves(pos, single_push_targets, Move::QuietMove, move_list, NORTH);
-		extract_pawn_moves(pos, double_push_targets, Move::DoublePawnPush, move_list, NORTH+NORTH);
-		extract_pawn_push_promotions(pos, promotions, move_list, NORTH);
+	inline Bitboard get_legal_targets(const Legal_masks &masks, int from) {
+		if (masks.pinned & (1ULL << from))
+			return masks.check_mask & line_bb[masks.king_square][from];
+		return masks.check_mask;
 	}
 
 	/*
-	 * Generate pseudolegal black pawn moves, without captures, for this position.
+	 * True if a pawn can move from one square to the other
+	 * without leaving the line of a pin.
 	 */
-	void generate_black_pawns_moves(Position &pos, Move_list &move_list) {
-		Bitboard empty_squares = pos.get_empty_squares();
-		Bitboard single_push_targets = (pos.get_piece_bitboard(BLACK, PAWN) >> 8) & empty_squares;
-		Bitboard double_push_targets = (single_push_targets >> 8) & Bitboards::ranks_bb[RANK_5] & empty_squares;
-		Bitboard promotions = single_push_targets & Bitboards::ranks_bb[RANK_1];
-		single_push_targets &= not_1_rank;
-		extract_pawn_moves(pos, single_push_targets, Move::QuietMove, move_list, SOUTH);
-		extract_pawn_moves(pos, double_push_targets, Move::DoublePawnPush, move_list, SOUTH+SOUTH);
-		extract_pawn_push_promotions(pos, promotions, move_list, SOUTH);
+	inline bool pin_allows(const Legal_masks &masks, int from, int to) {
+		return !(masks.pinned & (1ULL << from)) || (line_bb[masks.king_square][from] & (1ULL << to));
 	}
 
 	/*
-	 * Add pawn moves to the list.
+	 * Removes the squares attacked by the opponent from the king targets.
+	 * The king is removed from the occupancy, so it can't hide
+	 * from a slider behind itself.
 	 */
-	void extract_pawn_moves(Position &pos, Bitboard targets, int move_flags, Move_list &move_list, int direction) {
+	Bitboard get_safe_king_targets(Position &pos, Bitboard targets, int king_square, Bitboard occupied, Bitboard enemies) {
+		occupied ^= 1ULL << king_square;
+		Bitboard safe_targets = targets;
 		while (targets) {
 			int to = Bitboards::bit_scan_forward(targets);
-			Move move(move_flags, to - direction, to);
-			add_move(move_list, move);
+			if (pos.attackers_to(to, occupied) & enemies)
+				safe_targets &= ~(1ULL << to);
 			targets &= targets - 1;
 		}
+		return safe_targets;
 	}
 	// ******************************************************************************
 
-	// Captures move generator
+	// Generators
 	// ******************************************************************************
-
 	/*
-	 * Generate pseudolegal captures for this position.
+	 * Generate the moves of the given type for the side Us.
+	 * Moves are generated in this order: pawn captures, knights,
+	 * bishops, rooks, queens, king and pawn pushes. When in check,
+	 * the king moves go first, and nothing else in double check.
 	 */
-	void generate_captures(Position &pos, Move_list &move_list) {
-		generate_pawn_captures(pos, move_list);
-		generate_knight_captures(pos, move_list);
-		generate_bishop_captures(pos, move_list);
-		generate_rook_captures(pos, move_list);
-		generate_queen_captures(pos, move_list);
-		generate_king_captures(pos, move_list);
-	}
+	template<Color Us, Gen_type Type>
+	void generate(Position &pos, Move_list &move_list) {
+		Bitboard occupied = pos.get_occupancy();
+		Bitboard enemies = pos.get_occupied_squares(~Us);
+		Legal_masks masks = get_legal_masks<Us>(pos);
+
+		if (Type == PROMOTIONS) {
+			generate_pawn_pushes<Us, PROMOTIONS>(pos, move_list, masks, ~occupied);
+			return;
+		}
 
-	/*
-	 * Generate pseudolegal knight captures for this position.
-	 */
-	void generate_knight_captures(Position &pos, Move_list &move_list) {
-		Bitboard knights = pos.get_piece_bitboard(pos.get_side_to_move(), KNIGHT);
-		while(knights) {
-			int knight_index = Bitboards::bit_scan_forward(knights);
-			Bitboard capture_targets = knight_attacks[knight_index] & pos.get_occupied_squares(~pos.get_side_to_move());
-			extract_moves(pos, capture_targets, knight_index, Move::Capture, move_list, KNIGHT);
-			knights &= knights - 1;
+		if (Type == EVASIONS) {
+			generate_king_moves<Us, EVASIONS>(pos, move_list, masks, occupied, enemies);
+			if (!masks.check_mask)
+				return;
 		}
+
+		if (Type != QUIETS)
+			generate_pawn_captures<Us, Type>(pos, move_list, masks, enemies);
+
+		generate_piece_moves<KNIGHT, Type>(pos, move_list, masks, pos.get_piece_bitboard(Us, KNIGHT), occupied, enemies);
+		generate_piece_moves<BISHOP, Type>(pos, move_list, masks, pos.get_piece_bitboard(Us, BISHOP), occupied, enemies);
+		generate_piece_moves<ROOK, Type>(pos, move_list, masks, pos.get_piece_bitboard(Us, ROOK), occupied, enemies);
+		generate_piece_moves<QUEEN, Type>(pos, move_list, masks, pos.get_piece_bitboard(Us, QUEEN), occupied, enemies);
+
+		if (Type != EVASIONS)
+			generate_king_moves<Us, Type>(pos, move_list, masks, occupied, enemies);
+
+		if (Type != CAPTURES)
+			generate_pawn_pushes<Us, Type>(pos, move_list, masks, ~occupied);
 	}
 
 	/*
-	 * Generate pseudolegal bishop captures for this position.
+	 * Generate legal knight, bishop, rook or queen moves.
+	 * A pinned knight can never move, and a pinned piece
+	 * can never stop a check.
 	 */
-	void generate_bishop_captures(Position &pos, Move_list &move_list) {
-		Bitboard bishops = pos.get_piece_bitboard(pos.get_side_to_move(), BISHOP);
-		while(bishops) {
-			int bishop_index = Bitboards::bit_scan_forward(bishops);
-			Bitboard bishop_attacks = get_bishop_attacks(~pos.get_empty_squares(), bishop_index);
-			Bitboard capture_targets = bishop_attacks & pos.get_occupied_squares(~pos.get_side_to_move());
-			extract_moves(pos, capture_targets, bishop_index, Move::Capture, move_list, BISHOP);
-			bishops &= bishops - 1;
+	template<Piece_type Pt, Gen_type Type>
+	void generate_piece_moves(Position &pos, Move_list &move_list, const Legal_masks &masks,
+			Bitboard pieces, Bitboard occupied, Bitboard enemies) {
+		if (Pt == KNIGHT || Type == EVASIONS)
+			pieces &= ~masks.pinned;
+		while (pieces) {
+			int from = Bitboards::bit_scan_forward(pieces);
+			Bitboard targets;
+			if constexpr (Pt == KNIGHT)
+				targets = knight_attacks[from] & masks.check_mask;
+			else if constexpr (Pt == BISHOP)
+				targets = get_bishop_attacks(occupied, from) & get_legal_targets(masks, from);
+			else if constexpr (Pt == ROOK)
+				targets = get_rook_attacks(occupied, from) & get_legal_targets(masks, from);
+			else
+				targets = get_queen_attacks(occupied, from) & get_legal_targets(masks, from);
+			if (Type != CAPTURES)
+				extract_moves(pos, targets & ~occupied, from, Move::QuietMove, move_list, Pt);
+			if (Type != QUIETS)
+				extract_moves(pos, targets & enemies, from, Move::Capture, move_list, Pt);
+			pieces &= pieces - 1;
 		}
 	}
 
 	/*
-	 * Generate pseudolegal rook captures for this position.
+	 * Generate legal king moves, and castling
+	 * for the types that include quiet moves.
 	 */
-	void generate_rook_captures(Position &pos, Move_list &move_list) {
-		Bitboard rooks = pos.get_piece_bitboard(pos.get_side_to_move(), ROOK);
-		while(rooks) {
-			int rook_index = Bitboards::bit_scan_forward(rooks);
-			Bitboard rook_attacks = get_rook_attacks(~pos.get_empty_squares(), rook_index);
-			Bitboard capture_targets = rook_attacks & pos.get_occupied_squares(~pos.get_side_to_move());
-			extract_moves(pos, capture_targets, rook_index, Move::Capture, move_list, ROOK);
-			rooks &= rooks - 1;
-		}
+	template<Color Us, Gen_type Type>
+	void generate_king_moves(Position &pos, Move_list &move_list, const Legal_masks &masks,
+			Bitboard occupied, Bitboard enemies) {
+		int king_index = masks.king_square;
+		Bitboard targets = king_attacks[king_index] & (Type == CAPTURES ? enemies : Type == QUIETS ? ~occupied : ~occupied | enemies);
+		targets = get_safe_king_targets(pos, targets, king_index, occupied, enemies);
+		if (Type != CAPTURES)
+			extract_moves(pos, targets & ~occupied, king_index, Move::QuietMove, move_list, KING);
+		if (Type != QUIETS)
+			extract_moves(pos, targets & enemies, king_index, Move::Capture, move_list, KING);
+		if (Type == ALL || Type == QUIETS)
+			generate_castling_moves<Us>(pos, move_list, masks, occupied);
 	}
 
 	/*
-	 * Generate pseudolegal queen captures for this position.
+	 * Generate legal castling moves for this position.
+	 * The squares between the king and the rook must be empty;
+	 * Position::is_legal checks the castling rights and that the
+	 * king doesn't pass through an attacked square.
 	 */
-	void generate_queen_captures(Position &pos, Move_list &move_list) {
-		Bitboard queens = pos.get_piece_bitboard(pos.get_side_to_move(), QUEEN);
-		while(queens) {
-			int queen_index = Bitboards::bit_scan_forward(queens);
-			Bitboard queen_attacks = get_queen_attacks(~pos.get_empty_squares(), queen_index);
-			Bitboard capture_targets = queen_attacks & pos.get_occupied_squares(~pos.get_side_to_move());
-			extract_moves(pos, capture_targets, queen_index, Move::Capture, move_list, QUEEN);
-			queens &= queens - 1;
+	template<Color Us>
+	void generate_castling_moves(Position &pos, Move_list &move_list, const Legal_masks &masks, Bitboard occupied) {
+		constexpr int king_index = Us == WHITE ? E1 : E8;
+		if (masks.king_square != king_index || masks.check_mask != ~0ULL)
+			return;
+		Bitboard rooks = pos.get_piece_bitboard(Us, ROOK);
+		// Short castling
+		if (!(occupied & (3ULL << (king_index + 1))) && (rooks & (1ULL << (king_index + 3)))) {
+			Move move(Move::Castling, king_index, king_index + 2);
+			if (pos.is_legal(move))
+				add_move(move_list, move);
+		}
+		// Long castling
+		if (!(occupied & (7ULL << (king_index - 3))) && (rooks & (1ULL << (king_index - 4)))) {
+			Move move(Move::Castling, king_index, king_index - 2);
+			if (pos.is_legal(move))
+				add_move(move_list, move);
 		}
 	}
 
 	/*
-	 * Generate pseudolegal king captures for this position.
+	 * Generate legal pawn pushes: single and double pushes
+	 * unless only promotions are asked, and push promotions
+	 * unless only quiet moves are asked.
 	 */
-	void generate_king_captures(Position &pos, Move_list &move_list) {
-		Bitboard king_bitboard = pos.get_piece_bitboard(pos.get_side_to_move(), KING);
-		while(king_bitboard) {
-			int king_index = Bitboards::bit_scan_forward(king_bitboard);
-			Bitboard capture_targets = king_attacks[king_index] & pos.get_occupied_squares(~pos.get_side_to_move());
-			extract_moves(pos, capture_targets, king_index, Move::Capture, move_list, KING);
-			king_bitboard &= king_bitboard - 1;
+	template<Color Us, Gen_type Type>
+	void generate_pawn_pushes(Position &pos, Move_list &move_list, const Legal_masks &masks, Bitboard empty_squares) {
+		constexpr Direction up = Us == WHITE ? NORTH : SOUTH;
+		constexpr Bitboard double_push_rank = relative_rank_bb(Us, RANK_4);
+		constexpr Bitboard last_rank = relative_rank_bb(Us, RANK_8);
+		Bitboard pawns = pos.get_piece_bitboard(Us, PAWN);
+		if (Type == EVASIONS)
+			pawns &= ~masks.pinned;
+		Bitboard single_push_targets = shift<up>(pawns) & empty_squares;
+		if (Type != PROMOTIONS) {
+			Bitboard double_push_targets = shift<up>(single_push_targets) & double_push_rank & empty_squares & masks.check_mask;
+			extract_pawn_moves(single_push_targets & ~last_rank & masks.check_mask, Move::QuietMove, move_list, up, masks);
+			extract_pawn_moves(double_push_targets, Move::DoublePawnPush, move_list, up + up, masks);
 		}
+		if (Type != QUIETS)
+			extract_pawn_push_promotions(single_push_targets & last_rank & masks.check_mask, move_list, up, masks);
 	}
 
 	/*
-	 * Generate pseudolegal pawn captures for this position.
+	 * Generate legal pawn captures, capture promotions and enpassant.
 	 */
-	void generate_pawn_captures(Position &pos, Move_list &move_list) {
-		if (pos.get_side_to_move() == WHITE)
-			generate_white_pawns_captures(pos, move_list);
-		else
-			generate_black_pawns_captures(pos, move_list);
+	template<Color Us, Gen_type Type>
+	void generate_pawn_captures(Position &pos, Move_list &move_list, const Legal_masks &masks, Bitboard enemies) {
+		constexpr Direction left = Us == WHITE ? NORTH_WEST : SOUTH_EAST;
+		constexpr Direction right = Us == WHITE ? NORTH_EAST : SOUTH_WEST;
+		constexpr Bitboard last_rank = relative_rank_bb(Us, RANK_8);
+		Bitboard pawns = pos.get_piece_bitboard(Us, PAWN);
+		if (Type == EVASIONS)
+			pawns &= ~masks.pinned;
+		Bitboard left_targets = shift<left>(pawns);
+		Bitboard right_targets = shift<right>(pawns);
+		enemies &= masks.check_mask;
+		extract_pawn_captures(pos, left_targets & ~last_rank & enemies, Move::Capture, move_list, left, masks);
+		extract_pawn_captures(pos, right_targets & ~last_rank & enemies, Move::Capture, move_list, right, masks);
+		extract_pawn_capture_promotions(pos, left_targets & last_rank & enemies, move_list, left, masks);
+		extract_pawn_capture_promotions(pos, right_targets & last_rank & enemies, move_list, right, masks);
+		generate_enpassant_captures(pos, move_list, left_targets, right_targets, left, right);
 	}
 
 	/*
-	 * Generate pseudolegal white pawn captures for this position.
+	 * Generate legal enpassant captures. Enpassant removes two pawns
+	 * from the same rank, which can discover a check on the king,
+	 * so every enpassant capture gets a full legality test.
 	 */
-	void generate_white_pawns_captures(Position &pos, Move_list &move_list) {
-		Bitboard left_targets = (pos.get_piece_bitboard(WHITE, PAWN) << 7) & not_H_file;
-		Bitboard right_targets = (pos.get_piece_bitboard(WHITE, PAWN) << 9) & not_A_file;
-		Bitboard left_captures = left_targets & not_8_rank & pos.get_occupied_squares(BLACK);
-		Bitboard right_captures = right_targets & not_8_rank & pos.get_occupied_squares(BLACK);
-		Bitboard left_promotions = left_targets & ranks_bb[RANK_8] & pos.get_occupied_squares(BLACK);
-		Bitboard right_promotions = right_targets & ranks_bb[RANK_8] & pos.get_occupied_squares(BLACK);
-		extract_pawn_captures(pos, left_captures, Move::Capture, move_list, NORTH_WEST);
-		extract_pawn_captures(pos, right_captures, Move::Capture, move_list, NORTH_EAST);
-		extract_pawn_capture_promotions(pos, left_promotions, move_list, NORTH_WEST);
-		extract_pawn_capture_promotions(pos, right_promotions, move_list, NORTH_EAST);
-		// Enpassant
-		if (pos.get_enpassant_square() != NO_SQUARE) {
-			Bitboard enpassant_target = 1;
-			enpassant_target <<= pos.get_enpassant_square();
-			if (enpassant_target & left_targets) {
-				Move move(Move::Enpassant, pos.get_enpassant_square() - 7, pos.get_enpassant_square(), MVVLVA[PAWN][PAWN] + capture_score);
+	void generate_enpassant_captures(Position &pos, Move_list &move_list, Bitboard left_targets, Bitboard right_targets,
+			Direction left_direction, Direction right_direction) {
+		if (pos.get_enpassant_square() == NO_SQUARE)
+			return;
+		int to = pos.get_enpassant_square();
+		Bitboard enpassant_target = 1ULL << to;
+		if (enpassant_target & left_targets) {
+			Move move(Move::Enpassant, to - left_direction, to, MVVLVA[PAWN][PAWN] + capture_score);
+			if (pos.is_legal(move))
 				add_move(move_list, move);
-			}
-			if (enpassant_target & right_targets) {
-				Move move(Move::Enpassant, pos.get_enpassant_square() - 9, pos.get_enpassant_square(), MVVLVA[PAWN][PAWN] + capture_score);
+		}
+		if (enpassant_target & right_targets) {
+			Move move(Move::Enpassant, to - right_direction, to, MVVLVA[PAWN][PAWN] + capture_score);
+			if (pos.is_legal(move))
 				add_move(move_list, move);
-			}
 		}
 	}
+	// ******************************************************************************
 
+	// Extract moves
+	// ******************************************************************************
 	/*
-	 * Generate pseudolegal black pawn captures for this position.
+	 * Add pawn moves to the list.
 	 */
-	void generate_black_pawns_captures(Position &pos, Move_list &move_list) {
-		Bitboard left_targets = (pos.get_piece_bitboard(BLACK, PAWN) >> 7) & not_A_file;
-		Bitboard right_targets = (pos.get_piece_bitboard(BLACK, PAWN) >> 9) & not_H_file;
-		Bitboard left_captures = left_targets & not_1_rank & pos.get_occupied_squares(WHITE);
-		Bitboard right_captures = right_targets & not_1_rank & pos.get_occupied_squares(WHITE);
-		Bitboard left_promotions = left_targets & ranks_bb[RANK_1] & pos.get_occupied_squares(WHITE);
-		Bitboard right_promotions = right_targets & ranks_bb[RANK_1] & pos.get_occupied_squares(WHITE);
-		extract_pawn_captures(pos, left_captures, Move::Capture, move_list, SOUTH_EAST);
-		extract_pawn_captures(pos, right_captures, Move::Capture, move_list, SOUTH_WEST);
-		extract_pawn_capture_promotions(pos, left_promotions, move_list, SOUTH_EAST);
-		extract_pawn_capture_promotions(pos, right_promotions, move_list, SOUTH_WEST);
-		// Enpassant
-		if (pos.get_enpassant_square() != NO_SQUARE) {
-			Bitboard enpassant_target = 1;
-			enpassant_target <<= pos.get_enpassant_square();
-			if (enpassant_target & left_targets) {
-				Move move(Move::Enpassant, pos.get_enpassant_square() + 7, pos.get_enpassant_square(), MVVLVA[PAWN][PAWN] + capture_score);
-				add_move(move_list, move);
-			}
-			if (enpassant_target & right_targets) {
-				Move move(Move::Enpassant, pos.get_enpassant_square() + 9, pos.get_enpassant_square(), MVVLVA[PAWN][PAWN] + capture_score);
+	void extract_pawn_moves(Bitboard targets, int move_flags, Move_list &move_list, int direction, const Legal_masks &masks) {
+		while (targets) {
+			int to = Bitboards::bit_scan_forward(targets);
+			if (pin_allows(masks, to - direction, to)) {
+				Move move(move_flags, to - direction, to);
 				add_move(move_list, move);
 			}
+			targets &= targets - 1;
 		}
 	}
 
 	/*
 	 * Add pawn captures to the move list.
 	 */
-	void extract_pawn_captures(Position &pos, Bitboard targets, int move_flags, Move_list &move_list, Direction capture_direction) {
+	void extract_pawn_captures(Position &pos, Bitboard targets, int move_flags, Move_list &move_list, Direction capture_direction, const Legal_masks &masks) {
 		while (targets) {
 			int to = Bitboards::bit_scan_forward(targets);
-			Move move(move_flags, to - capture_direction, to, MVVLVA[pos.get_piece(to)][PAWN] + capture_score);
-			add_move(move_list, move);
+			if (pin_allows(masks, to - capture_direction, to)) {
+				Move move(move_flags, to - capture_direction, to, MVVLVA[pos.get_piece(to)][PAWN] + capture_score);
+				add_move(move_list, move);
+			}
 			targets &= targets - 1;
 		}
 	}
-	// ******************************************************************************
-
-	// Promotions move generator
-	// ******************************************************************************
-	/*
-	 * Generate pseudolegal promotions for this position.
-	 */
-	void generate_promotions(Position &pos, Move_list &move_list) {
-		if (pos.get_side_to_move() == WHITE)
-			generate_white_promotions(pos, move_list);
-		else
-			generate_black_promotions(pos, move_list);
-	}
-
-	/*
-	 * Generate pseudolegal white promotions for this position.
-	 */
-	void generate_white_promotions(Position &pos, Move_list &move_list) {
-		Bitboard single_push_targets = (pos.get_piece_bitboard(WHITE, PAWN) << 8) & pos.get_empty_squares();
-		Bitboard promotions = single_push_targets & Bitboards::ranks_bb[RANK_8];
-		extract_pawn_push_promotions(pos, promotions, move_list, NORTH);
-
-	}
-
-	/*
-	 * Generate pseudolegal black promotions for this position.
-	 */
-	void generate_black_promotions(Position &pos, Move_list &move_list) {
-		Bitboard single_push_targets = (pos.get_piece_bitboard(BLACK, PAWN) >> 8) & pos.get_empty_squares();
-		Bitboard promotions = single_push_targets & Bitboards::ranks_bb[RANK_1];
-		extract_pawn_push_promotions(pos, promotions, move_list, SOUTH);
-
-	}
 
 	/*
 	 * Add pawn promotions to the move list.
 	 */
-	void extract_pawn_push_promotions(Position &pos, Bitboard targets, Move_list &move_list, Direction direction) {
+	void extract_pawn_push_promotions(Bitboard targets, Move_list &move_list, Direction direction, const Legal_masks &masks) {
 		while (targets) {
 			int to = Bitboards::bit_scan_forward(targets);
-			Move move1(Move::PromotedKnight, to - direction, to, promotion_score);
-			Move move2(Move::PromotedQueen, to - direction, to, promotion_score + 1);
-			Move move3(Move::PromotedRook, to - direction, to, promotion_score);
-			Move move4(Move::PromotedBishop, to - direction, to, promotion_score);
-			add_move(move_list, move1);
-			add_move(move_list, move2);
-			add_move(move_list, move3);
-			add_move(move_list, move4);
+			if (pin_allows(masks, to - direction, to)) {
+				Move move1(Move::PromotedKnight, to - direction, to, promotion_score);
+				Move move2(Move::PromotedQueen, to - direction, to, promotion_score + 1);
+				Move move3(Move::PromotedRook, to - direction, to, promotion_score);
+				Move move4(Move::PromotedBishop, to - direction, to, promotion_score);
+				add_move(move_list, move1);
+				add_move(move_list, move2);
+				add_move(move_list, move3);
+				add_move(move_list, move4);
+			}
 			targets &= targets - 1;
 		}
 	}
@@ -458,21 +445,22 @@ namespace MoveGen {
 	/*
 	 * Add pawn captures to the move list.
 	 */
-	void extract_pawn_capture_promotions(Position &pos, Bitboard targets, Move_list &move_list, Direction direction) {
+	void extract_pawn_capture_promotions(Position &pos, Bitboard targets, Move_list &move_list, Direction direction, const Legal_masks &masks) {
 		while (targets) {
 			int to = Bitboards::bit_scan_forward(targets);
-			Move move1(Move::Capture | Move::PromotedKnight, to - direction, to, MVVLVA[pos.get_piece(to)][PAWN] + promotion_score + capture_score);
-			Move move2(Move::Capture | Move::PromotedQueen, to - direction, to, MVVLVA[pos.get_piece(to)][PAWN] + promotion_score + capture_score + 1);
-			Move move3(Move::Capture | Move::PromotedRook, to - direction, to, MVVLVA[pos.get_piece(to)][PAWN] + promotion_score + capture_score);
-			Move move4(Move::Capture | Move::PromotedBishop, to - direction, to, MVVLVA[pos.get_piece(to)][PAWN] + promotion_score + capture_score);
-			add_move(move_list, move1);
-			add_move(move_list, move2);
-			add_move(move_list, move3);
-			add_move(move_list, move4);
+			if (pin_allows(masks, to - direction, to)) {
+				Move move1(Move::Capture | Move::PromotedKnight, to - direction, to, MVVLVA[pos.get_piece(to)][PAWN] + promotion_score + capture_score);
+				Move move2(Move::Capture | Move::PromotedQueen, to - direction, to, MVVLVA[pos.get_piece(to)][PAWN] + promotion_score + capture_score + 1);
+				Move move3(Move::Capture | Move::PromotedRook, to - direction, to, MVVLVA[pos.get_piece(to)][PAWN] + promotion_score + capture_score);
+				Move move4(Move::Capture | Move::PromotedBishop, to - direction, to, MVVLVA[pos.get_piece(to)][PAWN] + promotion_score + capture_score);
+				add_move(move_list, move1);
+				add_move(move_list, move2);
+				add_move(move_list, move3);
+				add_move(move_list, move4);
+			}
 			targets &= targets - 1;
 		}
 	}
-	// ******************************************************************************
 
 	/*
 	 * Add moves to the move list.
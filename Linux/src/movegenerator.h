@@ -44,19 +44,30 @@ namespace MoveGen {
 	};
 
 	/*
-	 * Generate pseudo-legal moves in the position.
+	 * Generate legal moves in the position.
 	 */
 	void generate_moves(Position &pos, Move_list &move_list);
 
 	/*
-	 * Generate pseudo-legal captures in the position.
+	 * Generate legal moves that are neither captures
+	 * nor promotions in the position.
+	 */
+	void generate_quiet_moves(Position &pos, Move_list &move_list);
+
+	/*
+	 * Generate legal captures in the position.
 	 */
 	void generate_captures(Position &pos, Move_list &move_list);
 
 	/*
-	 * Generate pseudo-legal promotions in the position.
+	 * Generate legal promotions (without captures) in the position.
 	 */
 	void generate_promotions(Position &pos, Move_list &move_list);
+
+	/*
+	 * Generate legal moves when the side to move is in check.
+	 */
+	void generate_evasions(Position &pos, Move_list &move_list);
 }
 
 #endif /* SRC_MOVEGENERATOR_H_ */
@@ -0,0 +1,147 @@
+/*
+ * MORA CHESS ENGINE (MCE).
+ * Copyright (C) 2019 Gonzalo Arró.
+ *
+ * This file is part of MORA CHESS ENGINE.
+ *
+ * MORA CHESS ENGINE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MORA CHESS ENGINE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MORA CHESS ENGINE. If not, see <https://www.gnu.org/licenses/>
+ *
+ * Author: gonzalo.arro@gmail.com
+ */
+
+#include "movepicker.h"
+
+namespace Search {
+
+	/*
+	 * The killers are saved as move codes without score.
+	 */
+	Move_picker::Move_picker(Position &pos, Move hash_move, unsigned int killer_1, unsigned int killer_2, int (*history)[SQUARES], bool in_check) :
+			pos(pos), hash_move(hash_move), history(history), stage(HASH_MOVE), in_check(in_check), current(0) {
+		killers[0] = Move(killer_1 >> 12, (killer_1 >> 6) & 0x3f, killer_1);
+		killers[1] = Move(killer_2 >> 12, (killer_2 >> 6) & 0x3f, killer_2);
+	}
+
+	/*
+	 * Returns the next move of the current stage, moving
+	 * on to the next stage when the current one is empty.
+	 */
+	Move Move_picker::next_move() {
+		Move move;
+		switch (stage) {
+		case HASH_MOVE:
+			stage = in_check ? GENERATE_EVASIONS : GENERATE_CAPTURES;
+			if (pos.is_pseudo_legal(hash_move) && pos.is_legal(hash_move))
+				return hash_move;
+			return next_move();
+		case GENERATE_CAPTURES:
+			MoveGen::generate_captures(pos, move_list);
+			MoveGen::generate_promotions(pos, move_list);
+			current = 0;
+			stage = GOOD_CAPTURES;
+			[[fallthrough]];
+		case GOOD_CAPTURES:
+			while (current < move_list.size) {
+				move = pick_best();
+				if (move == hash_move)
+					continue;
+				if (!pos.see_ge(move, 0)) {
+					bad_captures.moves[bad_captures.size++] = move;
+					continue;
+				}
+				return move;
+			}
+			stage = FIRST_KILLER;
+			[[fallthrough]];
+		case FIRST_KILLER:
+			stage = SECOND_KILLER;
+			move = killers[0];
+			if (move != hash_move && !move.is_capture() && !move.is_promotion() && pos.is_pseudo_legal(move) && pos.is_legal(move))
+				return move;
+			[[fallthrough]];
+		case SECOND_KILLER:
+			stage = GENERATE_QUIETS;
+			move = killers[1];
+			if (move != hash_move && move != killers[0] && !move.is_capture() && !move.is_promotion() && pos.is_pseudo_legal(move) && pos.is_legal(move))
+				return move;
+			[[fallthrough]];
+		case GENERATE_QUIETS:
+			move_list.size = 0;
+			MoveGen::generate_quiet_moves(pos, move_list);
+			for (int i = 0; i < move_list.size; i++)
+				move_list.moves[i].set_score(history[move_list.moves[i].get_from()][move_list.moves[i].get_to()]);
+			current = 0;
+			stage = QUIETS;
+			[[fallthrough]];
+		case QUIETS:
+			while (current < move_list.size) {
+				move = pick_best();
+				if (move != hash_move && !is_killer(move))
+					return move;
+			}
+			current = 0;
+			stage = BAD_CAPTURES;
+			[[fallthrough]];
+		case BAD_CAPTURES:
+			if (current < bad_captures.size)
+				return bad_captures.moves[current++];
+			stage = DONE;
+			return Move();
+		case GENERATE_EVASIONS:
+			// Captures keep their MVV-LVA score, quiet moves get the history score
+			MoveGen::generate_evasions(pos, move_list);
+			for (int i = 0; i < move_list.size; i++) {
+				if (!move_list.moves[i].is_capture())
+					move_list.moves[i].set_score(history[move_list.moves[i].get_from()][move_list.moves[i].get_to()]);
+			}
+			current = 0;
+			stage = EVASIONS;
+			[[fallthrough]];
+		case EVASIONS:
+			while (current < move_list.size) {
+				move = pick_best();
+				if (move != hash_move)
+					return move;
+			}
+			stage = DONE;
+			[[fallthrough]];
+		default:
+			return Move();
+		}
+	}
+
+	/*
+	 * Returns the move with the best score among
+	 * the moves not picked yet.
+	 */
+	Move Move_picker::pick_best() {
+		int best_index = current;
+		for (int i = current + 1; i < move_list.size; i++) {
+			if (move_list.moves[i].get_score() > move_list.moves[best_index].get_score())
+				best_index = i;
+		}
+		Move best = move_list.moves[best_index];
+		move_list.moves[best_index] = move_list.moves[current];
+		move_list.moves[current] = best;
+		current++;
+		return best;
+	}
+
+	/*
+	 * Returns true if the move was already tried as a killer.
+	 */
+	bool Move_picker::is_killer(Move move) const {
+		return move == killers[0] || move == killers[1];
+	}
+}
@@ -0,0 +1,78 @@
+/*
+ * MORA CHESS ENGINE (MCE).
+ * Copyright (C) 2019 Gonzalo Arró.
+ *
+ * This file is part of MORA CHESS ENGINE.
+ *
+ * MORA CHESS ENGINE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MORA CHESS ENGINE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MORA CHESS ENGINE. If not, see <https://www.gnu.org/licenses/>
+ *
+ * Author: gonzalo.arro@gmail.com
+ */
+
+#ifndef SRC_MOVEPICKER_H_
+#define SRC_MOVEPICKER_H_
+
+#include "position.h"
+#include "movegenerator.h"
+
+namespace Search {
+
+	/*
+	 * Returns the moves of a node one by one, in stages:
+	 * hash move, winning captures (MVV-LVA), killers,
+	 * quiet moves (history) and losing captures (by SEE).
+	 * Every stage is generated only when it is reached,
+	 * so a cutoff by an early move saves the rest of the work.
+	 * In check, the hash move is followed by the check evasions.
+	 * Moves are legal.
+	 */
+	class Move_picker {
+	public:
+		Move_picker(Position &pos, Move hash_move, unsigned int killer_1, unsigned int killer_2, int (*history)[SQUARES], bool in_check);
+
+		// Next move, or a null move when there are no more moves
+		Move next_move();
+
+	private:
+		enum Stage {
+			HASH_MOVE,
+			GENERATE_CAPTURES,
+			GOOD_CAPTURES,
+			FIRST_KILLER,
+			SECOND_KILLER,
+			GENERATE_QUIETS,
+			QUIETS,
+			BAD_CAPTURES,
+			GENERATE_EVASIONS,
+			EVASIONS,
+			DONE
+		};
+
+		Position &pos;
+		Move hash_move;
+		Move killers[2];
+		int (*history)[SQUARES];
+		int stage;
+		bool in_check;
+		MoveGen::Move_list move_list;
+		MoveGen::Move_list bad_captures;
+		int current;
+
+		// Helpers
+		Move pick_best();
+		bool is_killer(Move move) const;
+	};
+}
+
+#endif /* SRC_MOVEPICKER_H_ */
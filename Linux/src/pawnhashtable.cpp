@@ -20,30 +20,16 @@
  * Author: gonzalo.arro@gmail.com
  */
 
-#include <vector>
-
 #include "pawnhashtable.h"
 
 namespace Evaluation {
 
-	// Hash table size
-	constexpr int pawn_hash_table_entries = 65536;
-
-	/*
-	 * Pawn hash table.
-	 */
-	std::vector<Pawn_hash_entry> pawns_hash_table;
-
-	void init() {
-		pawns_hash_table.reserve(pawn_hash_table_entries);
-	}
-
 	/*
 	 * Stores a hash entry.
 	 */
-	void store_hash_pawns(Key key, Pawns_info pawns_info) {
+	void store_hash_pawns(Pawn_hash_table &pawns_hash_table, Key key, Pawns_info pawns_info) {
 		// Get the corresponding entry
-		Pawn_hash_entry &hash_entry = pawns_hash_table[key % pawns_hash_table.capacity()];
+		Pawn_hash_entry &hash_entry = pawns_hash_table[key % pawns_hash_table.size()];
 		// Set the info
 		hash_entry.zobrist_key = key;
 		hash_entry.pawns_info.passed_pawns[WHITE] = pawns_info.passed_pawns[WHITE];
@@ -63,8 +49,8 @@ namespace Evaluation {
 	 * Get the position score from the pawn hash table
 	 * and load the pawn structure info.
 	 */
-	bool probe_hash_pawns(Key key, Pawns_info &pawns_info) {
-		Pawn_hash_entry hash_entry = pawns_hash_table[key % pawns_hash_table.capacity()];
+	bool probe_hash_pawns(Pawn_hash_table &pawns_hash_table, Key key, Pawns_info &pawns_info) {
+		Pawn_hash_entry &hash_entry = pawns_hash_table[key % pawns_hash_table.size()];
 		if (hash_entry.zobrist_key == key) {
 			pawns_info = hash_entry.pawns_info;
 			return true;
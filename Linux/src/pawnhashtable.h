@@ -23,6 +23,8 @@
 #ifndef SRC_PAWNHASHTABLE_H_
 #define SRC_PAWNHASHTABLE_H_
 
+#include <vector>
+
 #include "types.h"
 #include "bitboards.h"
 
@@ -43,21 +45,24 @@ struct Pawns_info {
   };
 
   /*
-   * Initializes the pawns hash table.
+   * Pawn hash table. Every search thread owns one.
    */
-  void init();
+  typedef std::vector<Pawn_hash_entry> Pawn_hash_table;
+
+  // Hash table size
+  constexpr int pawn_hash_table_entries = 65536;
 
   /*
    * Stores a hash entry into the pawns hash table.
    */
-  void store_hash_pawns(Key key, Pawns_info pawns_info);
+  void store_hash_pawns(Pawn_hash_table &pawns_hash_table, Key key, Pawns_info pawns_info);
 
   /*
    * Returns the pawn score assigned to the pawn structure corresponding to the key,
    * if the hash entry for the structure exists.
    * Also loads aditional info about the pawn structure.
    */
-  bool probe_hash_pawns(Key key, Pawns_info &pawns_info);
+  bool probe_hash_pawns(Pawn_hash_table &pawns_hash_table, Key key, Pawns_info &pawns_info);
 }
 
 #endif /* SRC_PAWNHASHTABLE_H_ */
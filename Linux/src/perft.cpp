@@ -0,0 +1,160 @@
+/*
+ * MORA CHESS ENGINE (MCE).
+ * Copyright (C) 2019 Gonzalo Arró.
+ *
+ * This file is part of MORA CHESS ENGINE.
+ *
+ * MORA CHESS ENGINE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MORA CHESS ENGINE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MORA CHESS ENGINE. If not, see <https://www.gnu.org/licenses/>
+ *
+ * Author: gonzalo.arro@gmail.com
+ */
+
+#include <iostream>
+#include <thread>
+
+#include "perft.h"
+#include "movegenerator.h"
+#include "timemanagement.h"
+
+namespace Perft {
+
+	// Helpers
+	bool probe_perft_hash(Perft_hash_table &hash_table, Key key, int depth, unsigned long long &nodes);
+	void store_perft_hash(Perft_hash_table &hash_table, Key key, int depth, unsigned long long nodes);
+	Perft_entry &get_entry(Perft_hash_table &hash_table, Key key, int depth);
+	void perft_worker(Position pos, int depth, std::vector<Move> &root_moves, std::vector<unsigned long long> &root_nodes,
+			std::atomic<int> &next_move, Perft_hash_table &hash_table);
+
+	/*
+	 * Perft with bulk counting: at depth 1 the size of
+	 * the legal move list is the node count.
+	 */
+	unsigned long long perft(Position &pos, int depth, Perft_hash_table &hash_table) {
+		MoveGen::Move_list move_list;
+		if (depth == 1) {
+			MoveGen::generate_moves(pos, move_list);
+			return move_list.size;
+		}
+
+		// The moves are only generated if the hash misses
+		unsigned long long nodes = 0;
+		Key key = pos.get_position_key();
+		if (probe_perft_hash(hash_table, key, depth, nodes))
+			return nodes;
+
+		MoveGen::generate_moves(pos, move_list);
+		State_info state;
+
+		for (int i = 0; i < move_list.size; i++) {
+			pos.make_move(move_list.moves[i], state);
+			nodes += perft(pos, depth - 1, hash_table);
+			pos.undo_move();
+		}
+
+		store_perft_hash(hash_table, key, depth, nodes);
+		return nodes;
+	}
+
+	/*
+	 * Runs perft or divide and prints the results.
+	 * Every thread takes the next root move not counted
+	 * yet and searches it on its own copy of the position.
+	 */
+	void run(Position &pos, int depth, bool divide, int hash_size_mb, int threads) {
+		if (depth < 1)
+			return;
+
+		Perft_hash_table hash_table(((unsigned long long)hash_size_mb << 20) / sizeof(Perft_entry));
+
+		long long start_time = Time::get_current_time_in_milliseconds();
+
+		// Root moves
+		MoveGen::Move_list move_list;
+		MoveGen::generate_moves(pos, move_list);
+		std::vector<Move> root_moves(move_list.moves, move_list.moves + move_list.size);
+
+		std::vector<unsigned long long> root_nodes(root_moves.size(), 1);
+		if (depth > 1) {
+			std::atomic<int> next_move(0);
+			std::vector<std::thread> workers;
+			for (int i = 1; i < threads; i++)
+				workers.push_back(std::thread(perft_worker, pos, depth - 1, std::ref(root_moves), std::ref(root_nodes),
+						std::ref(next_move), std::ref(hash_table)));
+			perft_worker(pos, depth - 1, root_moves, root_nodes, next_move, hash_table);
+			for (std::thread &worker : workers)
+				worker.join();
+		}
+
+		unsigned long long nodes = 0;
+		for (unsigned int i = 0; i < root_moves.size(); i++) {
+			nodes += root_nodes[i];
+			if (divide)
+				std::cout << root_moves[i].long_algebraic_notation() << ": " << root_nodes[i] << std::endl;
+		}
+
+		long long time = Time::get_current_time_in_milliseconds() - start_time;
+		std::cout << "info depth " << depth << " nodes " << nodes << " time " << time;
+		std::cout << " nps " << (time > 0 ? nodes * 1000 / time : nodes) << std::endl;
+	}
+
+	/*
+	 * Counts root moves until there are none left.
+	 */
+	void perft_worker(Position pos, int depth, std::vector<Move> &root_moves, std::vector<unsigned long long> &root_nodes,
+			std::atomic<int> &next_move, Perft_hash_table &hash_table) {
+		int i;
+		State_info state;
+		while ((i = next_move++) < (int)root_moves.size()) {
+			pos.make_move(root_moves[i], state);
+			root_nodes[i] = perft(pos, depth, hash_table);
+			pos.undo_move();
+		}
+	}
+
+	/*
+	 * Returns the entry for a key and a depth. The depth is
+	 * mixed into the index so the same position at different
+	 * depths doesn't compete for one slot.
+	 */
+	Perft_entry &get_entry(Perft_hash_table &hash_table, Key key, int depth) {
+		return hash_table[(key ^ (depth * 0x9E3779B97F4A7C15ULL)) % hash_table.size()];
+	}
+
+	/*
+	 * Looks for the node count of the position at that depth.
+	 */
+	bool probe_perft_hash(Perft_hash_table &hash_table, Key key, int depth, unsigned long long &nodes) {
+		if (hash_table.empty())
+			return false;
+		Perft_entry &entry = get_entry(hash_table, key, depth);
+		unsigned long long data = entry.data.load(std::memory_order_relaxed);
+		if ((entry.key.load(std::memory_order_relaxed) ^ data) == key && (int)(data & 0xFF) == depth) {
+			nodes = data >> 8;
+			return true;
+		}
+		return false;
+	}
+
+	/*
+	 * Saves the node count of the position at that depth.
+	 */
+	void store_perft_hash(Perft_hash_table &hash_table, Key key, int depth, unsigned long long nodes) {
+		if (hash_table.empty())
+			return;
+		Perft_entry &entry = get_entry(hash_table, key, depth);
+		unsigned long long data = (nodes << 8) | depth;
+		entry.key.store(key ^ data, std::memory_order_relaxed);
+		entry.data.store(data, std::memory_order_relaxed);
+	}
+}
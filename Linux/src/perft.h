@@ -0,0 +1,62 @@
+/*
+ * MORA CHESS ENGINE (MCE).
+ * Copyright (C) 2019 Gonzalo Arró.
+ *
+ * This file is part of MORA CHESS ENGINE.
+ *
+ * MORA CHESS ENGINE is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MORA CHESS ENGINE is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MORA CHESS ENGINE. If not, see <https://www.gnu.org/licenses/>
+ *
+ * Author: gonzalo.arro@gmail.com
+ */
+
+#ifndef SRC_PERFT_H_
+#define SRC_PERFT_H_
+
+#include <vector>
+#include <atomic>
+
+#include "position.h"
+
+namespace Perft {
+
+	/*
+	 * Perft hash entry. The depth is saved in the low 8 bits
+	 * of data and the node count above them. The table is shared
+	 * between threads without locks: the key is saved xored with
+	 * the data, so a torn entry just doesn't match.
+	 */
+	struct Perft_entry {
+		std::atomic<Key> key;
+		std::atomic<unsigned long long> data;
+	};
+
+	typedef std::vector<Perft_entry> Perft_hash_table;
+
+	/*
+	 * Counts the leaf nodes of the move tree up to the given depth.
+	 * The hash table is optional (it can be empty).
+	 */
+	unsigned long long perft(Position &pos, int depth, Perft_hash_table &hash_table);
+
+	/*
+	 * Runs perft from the position and prints the node count,
+	 * the time and the nodes per second. With divide it also
+	 * prints the node count of every root move.
+	 * The root moves are split between the given number of threads.
+	 * hash_size_mb = 0 disables the perft hash table.
+	 */
+	void run(Position &pos, int depth, bool divide, int hash_size_mb, int threads);
+}
+
+#endif /* SRC_PERFT_H_ */
@@ -20,8 +20,7 @@
  * Author: gonzalo.arro@gmail.com
  */
 
-#include <random>
-#include <cmath>
+#include <algorithm>
 #include <iostream>
 
 #include "position.h"
@@ -32,12 +31,128 @@
  * Zobrist Hashing.
  */
 namespace Zobrist {
-	constexpr int ZOBRIST_SEED = 3596592594;
 
-	Key pieces[PIECE_TYPES][SQUARES];
-	Key enpassant_square[FILES];
-	Key castling_rights[16];
-	Key black_to_move;
+	/*
+	 * Random keys, generated at compile time with a xorshift64*
+	 * generator seeded with ZOBRIST_SEED.
+	 */
+	struct Keys {
+		Key pieces[PIECE_TYPES][SQUARES];
+		Key enpassant_square[FILES];
+		Key castling_rights[16];
+		Key black_to_move;
+	};
+
+	constexpr Key next_key(Key &state) {
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		// Full 64 bits keys: the hash tables index with the upper bits
+		return state * 2685821657736338717ULL;
+	}
+
+	constexpr Keys init_keys() {
+		Keys keys = {};
+		Key state = ZOBRIST_SEED;
+
+		// A random key for each piece on each square
+		for (int piece_type = 0; piece_type < PIECE_TYPES; piece_type++) {
+			for (int square = 0; square < SQUARES; square++)
+				keys.pieces[piece_type][square] = next_key(state);
+		}
+
+		// A random key for an enpassant square on each file
+		for (int file = FILE_A; file <= FILE_H; file++)
+			keys.enpassant_square[file] = next_key(state);
+
+		for (int i = 0; i < 16; i++)
+			keys.castling_rights[i] = next_key(state);
+
+		keys.black_to_move = next_key(state);
+		return keys;
+	}
+
+	constexpr Keys keys = init_keys();
+	constexpr auto &pieces = keys.pieces;
+	constexpr auto &enpassant_square = keys.enpassant_square;
+	constexpr auto &castling_rights = keys.castling_rights;
+	constexpr const Key &black_to_move = keys.black_to_move;
+}
+
+/*
+ * Cuckoo hashing of the reversible moves, to detect upcoming
+ * repetitions. Every move of a piece (no pawns) between two squares
+ * on an empty board is stored by the key difference it makes, both
+ * directions share the entry. Each key has two possible slots.
+ */
+namespace Cuckoo {
+
+	constexpr int SIZE = 8192;
+	constexpr int REVERSIBLE_MOVES = 3668;
+
+	struct Table {
+		Key keys[SIZE];
+		unsigned short moves[SIZE]; // from << 6 | to, 0 if empty
+		int count;
+	};
+
+	constexpr int first_slot(Key key) {
+		return key & (SIZE - 1);
+	}
+
+	constexpr int second_slot(Key key) {
+		return (key >> 16) & (SIZE - 1);
+	}
+
+	/*
+	 * True if the piece can move between the squares on an empty board.
+	 */
+	constexpr bool piece_moves_between(int piece_type, int from, int to) {
+		int file_distance = from % 8 > to % 8 ? from % 8 - to % 8 : to % 8 - from % 8;
+		int rank_distance = from / 8 > to / 8 ? from / 8 - to / 8 : to / 8 - from / 8;
+		bool diagonal = file_distance == rank_distance;
+		bool straight = file_distance == 0 || rank_distance == 0;
+		switch (piece_type) {
+		case KNIGHT: return file_distance * rank_distance == 2;
+		case BISHOP: return diagonal;
+		case ROOK: return straight;
+		case QUEEN: return diagonal || straight;
+		case KING: return file_distance <= 1 && rank_distance <= 1;
+		}
+		return false;
+	}
+
+	constexpr Table init_table() {
+		Table table = {};
+		for (int piece = 0; piece < PIECE_TYPES; piece++) {
+			if (piece % 6 == PAWN)
+				continue;
+			for (int from = A1; from <= H8; from++) {
+				for (int to = from + 1; to <= H8; to++) {
+					if (!piece_moves_between(piece % 6, from, to))
+						continue;
+					Key key = Zobrist::pieces[piece][from] ^ Zobrist::pieces[piece][to] ^ Zobrist::black_to_move;
+					unsigned short move = from << 6 | to;
+					// Insert, moving the entry in the slot to its other slot
+					int slot = first_slot(key);
+					while (move) {
+						Key displaced_key = table.keys[slot];
+						unsigned short displaced_move = table.moves[slot];
+						table.keys[slot] = key;
+						table.moves[slot] = move;
+						key = displaced_key;
+						move = displaced_move;
+						slot = slot == first_slot(key) ? second_slot(key) : first_slot(key);
+					}
+					table.count++;
+				}
+			}
+		}
+		return table;
+	}
+
+	constexpr Table table = init_table();
+	static_assert(table.count == REVERSIBLE_MOVES, "Wrong number of reversible moves");
 }
 
 /*
@@ -56,44 +171,35 @@ const int CASTLING_RIGHT_UPDATE[SQUARES] = {
 };
 
 /*
- * Initializes static data.
+ * Constructor for the initial setup.
  */
-void Position::init() {
-	init_hash_keys();
+Position::Position(std::string fen) {
+	load_FEN(fen);
 }
 
 /*
- * Initializes random keys for Zobrist Hashing
+ * Copy constructor. The copy owns its current state, the
+ * previous states are shared with the original position.
  */
-void Position::init_hash_keys() {
-	std::mt19937_64 e2(Zobrist::ZOBRIST_SEED);
-    std::uniform_int_distribution<long long int> dist(
-    		std::llround(std::pow(2,61)),
-    		std::llround(std::pow(2,62)));
-
-    // Initializes a random key for each piece on each square
-	for (int piece_type = 0; piece_type < PIECE_TYPES; piece_type++) {
-		for (int square = 0; square < SQUARES; square++)
-			Zobrist::pieces[piece_type][square] = dist(e2);
-	}
-
-    // Initializes a random key for an enpassant square on each file
-	for (int file = FILE_A; file <= FILE_H; file++) {
-		Zobrist::enpassant_square[file] = dist(e2);
-	}
-
-	for (int i = 0; i < 16; i++) {
-		Zobrist::castling_rights[i] = dist(e2);
-	}
-
-	Zobrist::black_to_move = dist(e2);
+Position::Position(const Position &other) {
+	*this = other;
 }
 
 /*
- * Constructor for the initial setup.
+ * Copy assignment, see the copy constructor.
  */
-Position::Position(std::string fen) {
-	load_FEN(fen);
+Position &Position::operator=(const Position &other) {
+	std::copy(&other.piece_bitboards[0][0], &other.piece_bitboards[0][0] + PIECE_TYPES, &piece_bitboards[0][0]);
+	std::copy(other.occupied_squares, other.occupied_squares + PLAYERS, occupied_squares);
+	std::copy(other.board_mailbox, other.board_mailbox + SQUARES, board_mailbox);
+	std::copy(other.material, other.material + PLAYERS, material);
+	std::copy(other.psq_score, other.psq_score + PLAYERS, psq_score);
+	side_to_move = other.side_to_move;
+	history_ply = other.history_ply;
+	search_ply = other.search_ply;
+	root_state = *other.state;
+	state = &root_state;
+	return *this;
 }
 
 /*
@@ -157,10 +263,10 @@ void Position::load_FEN(std::string s) {
 	// Castling rights
 	while (s[i] != ' ') {
 		switch(s[i]) {
-		case('K'): castling_rights |= WHITE_SHORT; break;
-		case('Q'): castling_rights |= WHITE_LONG; break;
-		case('k'): castling_rights |= BLACK_SHORT; break;
-		case('q'): castling_rights |= BLACK_LONG; break;
+		case('K'): state->castling_rights |= WHITE_SHORT; break;
+		case('Q'): state->castling_rights |= WHITE_LONG; break;
+		case('k'): state->castling_rights |= BLACK_SHORT; break;
+		case('q'): state->castling_rights |= BLACK_LONG; break;
 		}
 		i++;
 	}
@@ -170,14 +276,14 @@ void Position::load_FEN(std::string s) {
 		int file = s[i] - 97;
 		i++;
 		int rank = s[i] - 49;
-		enpassant_square = rank * 8 + file;
+		state->enpassant_square = rank * 8 + file;
 	}
 	i += 2;
 	// Fifty count
 	while (s[i] != ' ') {
 		int digit = s[i] - 48;
-		fifty_count *= 10;
-		fifty_count += digit;
+		state->fifty_count *= 10;
+		state->fifty_count += digit;
 		i++;
 	}
 	i++;
@@ -198,6 +304,8 @@ void Position::load_FEN(std::string s) {
 	}
 	// Material
 	init_material(color);
+	// Checkers and pinned pieces
+	set_check_info();
 }
 
 /*
@@ -206,14 +314,21 @@ void Position::load_FEN(std::string s) {
 void Position::reset_board() {
 	reset_mailbox();
 	reset_bitboards();
-	fifty_count = 0;
-	castling_rights = 0;
-	enpassant_square = NO_SQUARE;
+	state = &root_state;
+	state->previous = nullptr;
+	state->move = Move();
+	state->captured_piece = EMPTY;
+	state->plies_from_null = 0;
+	state->fifty_count = 0;
+	state->castling_rights = 0;
+	state->enpassant_square = NO_SQUARE;
 	side_to_move = WHITE;
 	history_ply = 0;
 	search_ply = 0;
 	material[WHITE] = 0;
 	material[BLACK] = 0;
+	psq_score[WHITE] = 0;
+	psq_score[BLACK] = 0;
 }
 
 /*
@@ -241,47 +356,47 @@ void Position::reset_bitboards() {
  * Sets the position key for zobrist hashing.
  */
 void Position::set_position_key(int * color) {
-	position_key = 0;
+	state->position_key = 0;
 
-	position_key ^= Zobrist::castling_rights[castling_rights];
+	state->position_key ^= Zobrist::castling_rights[state->castling_rights];
 
 	for (int square = A1; square <= H8; square++) {
 		int piece = board_mailbox[square];
 		if (piece != EMPTY)
-			position_key ^= Zobrist::pieces[piece + color[square] * 6][square];
+			state->position_key ^= Zobrist::pieces[piece + color[square] * 6][square];
 	}
 
-	if (enpassant_square != NO_SQUARE) {
-		int file = enpassant_square % 8;
-		position_key ^= Zobrist::enpassant_square[file];
+	if (state->enpassant_square != NO_SQUARE) {
+		int file = state->enpassant_square % 8;
+		state->position_key ^= Zobrist::enpassant_square[file];
 	}
 
 	if (side_to_move == BLACK)
-		position_key ^= Zobrist::black_to_move;
+		state->position_key ^= Zobrist::black_to_move;
 }
 
 /*
  * Sets the pawns key for zobrist hashing.
  */
 void Position::set_pawns_key(int * color) {
-	pawns_key = 0;
+	state->pawns_key = 0;
 	for (int square = A1; square <= H8; square++) {
 		int piece = board_mailbox[square];
 		if (piece == PAWN)
-			pawns_key ^= Zobrist::pieces[PAWN + color[square] * 6][square];
+			state->pawns_key ^= Zobrist::pieces[PAWN + color[square] * 6][square];
 	}
 }
 
 /*
- * Initializes the material for each side.
+ * Initializes the material and piece-square score for each side.
  */
 void Position::init_material(int * color) {
 	for (int square = A1; square <= H8; square++) {
-		int piece_value = Evaluation::get_piece_value(board_mailbox[square]);
-		if (color[square] == WHITE)
-			material[WHITE] += piece_value;
-		else
-			material[BLACK] += piece_value;
+		int piece = board_mailbox[square];
+		if (piece != EMPTY) {
+			material[color[square]] += Evaluation::get_piece_value(piece);
+			psq_score[color[square]] += Evaluation::psq_table[color[square]][piece][square];
+		}
 	}
 }
 
@@ -292,15 +407,10 @@ void Position::undo_move() {
 	search_ply--;
 	history_ply--;
 
-	// Restore irreversible aspects of the position
-	fifty_count = moves_history[history_ply].fifty_count;
-	position_key = moves_history[history_ply].position_key;
-	pawns_key = moves_history[history_ply].pawns_key;
-	castling_rights = moves_history[history_ply].castling_rights;
-	enpassant_square = moves_history[history_ply].enpassant_square;
-
-	// Get move info
-	Move move = moves_history[history_ply].move;
+	// Get move info and restore the irreversible aspects of the position
+	Move move = state->move;
+	int captured_piece = state->captured_piece;
+	state = state->previous;
 	int from = move.get_from();
 	int to = move.get_to();
 
@@ -311,31 +421,31 @@ void Position::undo_move() {
 	Bitboards::clear_bit(piece_bitboards[side_to_move][moved_piece], to);
 	Bitboards::clear_bit(occupied_squares[side_to_move], to);
 	board_mailbox[to] = EMPTY;
-	material[side_to_move] -= Evaluation::get_piece_value(moved_piece, to, side_to_move);
+	psq_score[side_to_move] -= Evaluation::psq_table[side_to_move][moved_piece][to];
 
 	// Promotion
 	if (move.is_promotion()) {
+		material[side_to_move] -= Evaluation::get_piece_value(moved_piece) - Evaluation::get_piece_value(PAWN);
 		moved_piece = PAWN;
-
 	}
-	material[side_to_move] += Evaluation::get_piece_value(moved_piece, from, side_to_move);
+	psq_score[side_to_move] += Evaluation::psq_table[side_to_move][moved_piece][from];
 	board_mailbox[from] = moved_piece;
 	Bitboards::set_bit(piece_bitboards[side_to_move][moved_piece], from);
 	Bitboards::set_bit(occupied_squares[side_to_move], from);
 
 	// Capture
 	if (move.is_capture()) {
-		int captured_piece = moves_history[history_ply].captured_piece;
 		int piece_captured_square = to;
 
 		// Enpassant
 		if (move.is_enpassant())
-			piece_captured_square = enpassant_square - 8 + 16 * side_to_move;
+			piece_captured_square = state->enpassant_square - 8 + 16 * side_to_move;
 
 		Bitboards::set_bit(piece_bitboards[~side_to_move][captured_piece], piece_captured_square);
 		Bitboards::set_bit(occupied_squares[~side_to_move], piece_captured_square);
 		board_mailbox[piece_captured_square] = captured_piece;
-		material[~side_to_move] += Evaluation::get_piece_value(captured_piece, piece_captured_square, ~side_to_move);
+		material[~side_to_move] += Evaluation::get_piece_value(captured_piece);
+		psq_score[~side_to_move] += Evaluation::psq_table[~side_to_move][captured_piece][piece_captured_square];
 	}
 
 	// Castling move
@@ -346,8 +456,7 @@ void Position::undo_move() {
 			rook_from = to - 2;
 			rook_to = to + 1;
 		}
-		material[side_to_move] += Evaluation::get_piece_value(ROOK, rook_from, side_to_move);
-		material[side_to_move] -= Evaluation::get_piece_value(ROOK, rook_to, side_to_move);
+		psq_score[side_to_move] += Evaluation::psq_table[side_to_move][ROOK][rook_from] - Evaluation::psq_table[side_to_move][ROOK][rook_to];
 
 		board_mailbox[rook_from] = ROOK;
 		board_mailbox[rook_to] = EMPTY;
@@ -361,16 +470,17 @@ void Position::undo_move() {
 
 /*
  * Makes a move in this position.
- * Returns true if the move is legal, false otherwise.
+ * The move must be legal. The new state must stay
+ * alive until the move is undone.
  */
-bool Position::make_move(Move &move) {
-	// Save irreversive aspects of the position
-	moves_history[history_ply].fifty_count = fifty_count;
-	moves_history[history_ply].castling_rights = castling_rights;
-	moves_history[history_ply].enpassant_square = enpassant_square;
-	moves_history[history_ply].position_key = position_key;
-	moves_history[history_ply].pawns_key = pawns_key;
-	moves_history[history_ply].move = move;
+void Position::make_move(Move move, State_info &new_state) {
+	// The new state starts as a copy, the old one is kept to undo the move
+	new_state = *state;
+	new_state.previous = state;
+	new_state.move = move;
+	new_state.captured_piece = EMPTY;
+	new_state.plies_from_null++;
+	state = &new_state;
 
 	search_ply++;
 
@@ -380,8 +490,7 @@ bool Position::make_move(Move &move) {
 	int moved_piece = board_mailbox[from];
 	int captured_piece = board_mailbox[to];
 
-	material[side_to_move] -= Evaluation::get_piece_value(moved_piece, from, side_to_move);
-	material[side_to_move] += Evaluation::get_piece_value(moved_piece, to, side_to_move);
+	psq_score[side_to_move] += Evaluation::psq_table[side_to_move][moved_piece][to] - Evaluation::psq_table[side_to_move][moved_piece][from];
 
 	board_mailbox[from] = EMPTY;
 	board_mailbox[to] = moved_piece;
@@ -389,13 +498,13 @@ bool Position::make_move(Move &move) {
 	Bitboards::clear_bit(occupied_squares[side_to_move], from);
 	Bitboards::set_bit(piece_bitboards[side_to_move][moved_piece], to);
 	Bitboards::set_bit(occupied_squares[side_to_move], to);
-	position_key ^= Zobrist::pieces[moved_piece + side_to_move * 6][from];
-	position_key ^= Zobrist::pieces[moved_piece + side_to_move * 6][to];
+	state->position_key ^= Zobrist::pieces[moved_piece + side_to_move * 6][from];
+	state->position_key ^= Zobrist::pieces[moved_piece + side_to_move * 6][to];
 
 	if (moved_piece == PAWN) {
-		fifty_count = -1;
-		pawns_key ^= Zobrist::pieces[PAWN + side_to_move * 6][from];
-		pawns_key ^= Zobrist::pieces[PAWN + side_to_move * 6][to];
+		state->fifty_count = -1;
+		state->pawns_key ^= Zobrist::pieces[PAWN + side_to_move * 6][from];
+		state->pawns_key ^= Zobrist::pieces[PAWN + side_to_move * 6][to];
 
 		// Promotion
 		if (move.is_promotion()) {
@@ -403,11 +512,12 @@ bool Position::make_move(Move &move) {
 			board_mailbox[to] = promoted_piece;
 			Bitboards::set_bit(piece_bitboards[side_to_move][promoted_piece], to);
 			Bitboards::clear_bit(piece_bitboards[side_to_move][moved_piece], to);
-			position_key ^= Zobrist::pieces[moved_piece + side_to_move * 6][to];
-			position_key ^= Zobrist::pieces[promoted_piece + side_to_move * 6][to];
-			pawns_key ^= Zobrist::pieces[PAWN + side_to_move * 6][to];
-			material[side_to_move] -= Evaluation::get_piece_value(moved_piece, to, side_to_move);
-			material[side_to_move] += Evaluation::get_piece_value(promoted_piece, to, side_to_move);
+			state->position_key ^= Zobrist::pieces[moved_piece + side_to_move * 6][to];
+			state->position_key ^= Zobrist::pieces[promoted_piece + side_to_move * 6][to];
+			state->pawns_key ^= Zobrist::pieces[PAWN + side_to_move * 6][to];
+			psq_score[side_to_move] -= Evaluation::psq_table[side_to_move][moved_piece][to];
+			psq_score[side_to_move] += Evaluation::psq_table[side_to_move][promoted_piece][to];
+			material[side_to_move] += Evaluation::get_piece_value(promoted_piece) - Evaluation::get_piece_value(PAWN);
 		}
 	}
 
@@ -416,31 +526,27 @@ bool Position::make_move(Move &move) {
 		int capture_square = to;
 		if (move.is_enpassant()) {
 			captured_piece = PAWN;
-			capture_square = enpassant_square - 8 + side_to_move * 16;
+			capture_square = state->enpassant_square - 8 + side_to_move * 16;
 			board_mailbox[capture_square] = EMPTY;
 		}
 		Bitboards::clear_bit(piece_bitboards[~side_to_move][captured_piece], capture_square);
 		Bitboards::clear_bit(occupied_squares[~side_to_move], capture_square);
-		position_key ^= Zobrist::pieces[captured_piece + ~side_to_move * 6][capture_square];
-		fifty_count = -1;
-		material[~side_to_move] -= Evaluation::get_piece_value(captured_piece, capture_square, ~side_to_move);
-		moves_history[history_ply].captured_piece = captured_piece;
+		state->position_key ^= Zobrist::pieces[captured_piece + ~side_to_move * 6][capture_square];
+		state->fifty_count = -1;
+		material[~side_to_move] -= Evaluation::get_piece_value(captured_piece);
+		psq_score[~side_to_move] -= Evaluation::psq_table[~side_to_move][captured_piece][capture_square];
+		state->captured_piece = captured_piece;
 		if (captured_piece == PAWN)
-			pawns_key ^= Zobrist::pieces[PAWN + ~side_to_move * 6][capture_square];
+			state->pawns_key ^= Zobrist::pieces[PAWN + ~side_to_move * 6][capture_square];
 	}
 	history_ply++;
 	// Castling
-	bool illegal_castling = false;
 	if (move.is_castling()) {
 		int rook_from = to + 1;
 		int rook_to = to - 1;
-		int needed_right = side_to_move == WHITE ? WHITE_SHORT : BLACK_SHORT;
 		if (to - from < 0) { // Queen castling
 			rook_from = to - 2;
 			rook_to = to + 1;
-			needed_right = side_to_move == WHITE ? WHITE_LONG : BLACK_LONG;
-			if (board_mailbox[rook_from + 1] != EMPTY)
-				illegal_castling = true;
 		}
 
 		board_mailbox[rook_from] = EMPTY;
@@ -448,48 +554,81 @@ bool Position::make_move(Move &move) {
 
 		Bitboards::clear_bit(piece_bitboards[side_to_move][ROOK], rook_from);
 		Bitboards::clear_bit(occupied_squares[side_to_move], rook_from);
-		position_key ^= Zobrist::pieces[ROOK + side_to_move * 6][rook_from];
+		state->position_key ^= Zobrist::pieces[ROOK + side_to_move * 6][rook_from];
 		Bitboards::set_bit(piece_bitboards[side_to_move][ROOK], rook_to);
 		Bitboards::set_bit(occupied_squares[side_to_move], rook_to);
-		position_key ^= Zobrist::pieces[ROOK + side_to_move * 6][rook_to];
+		state->position_key ^= Zobrist::pieces[ROOK + side_to_move * 6][rook_to];
 
-		material[side_to_move] -= Evaluation::get_piece_value(ROOK, rook_from, side_to_move);
-		material[side_to_move] += Evaluation::get_piece_value(ROOK, rook_to, side_to_move);
+		psq_score[side_to_move] += Evaluation::psq_table[side_to_move][ROOK][rook_to] - Evaluation::psq_table[side_to_move][ROOK][rook_from];
+	}
 
-		illegal_castling =	 illegal_castling ||
-							!(castling_rights & needed_right) ||
-							is_attacked(rook_to, ~side_to_move) ||
-							is_attacked(from, ~side_to_move);
+	side_to_move = ~side_to_move;
+	state->fifty_count++;
 
+	if (state->enpassant_square != NO_SQUARE) {
+		state->position_key ^= Zobrist::enpassant_square[state->enpassant_square & 7];
+		state->enpassant_square = NO_SQUARE;
+	}
+	if (move.is_double_pawn_push()) {
+		state->enpassant_square = to + 8 - side_to_move * 16;
+		state->position_key ^= Zobrist::enpassant_square[state->enpassant_square & 7];
 	}
 
-	int king_square = Bitboards::bit_scan_forward(piece_bitboards[side_to_move][KING]);
+	state->position_key ^= Zobrist::black_to_move; // remove it or add it depending on side to move
 
-	side_to_move = ~side_to_move;
-	fifty_count++;
+	state->position_key ^= Zobrist::castling_rights[state->castling_rights];
+	state->castling_rights &= CASTLING_RIGHT_UPDATE[from];
+	state->castling_rights &= CASTLING_RIGHT_UPDATE[to];
+	state->position_key ^= Zobrist::castling_rights[state->castling_rights];
 
-	if (is_attacked(king_square, side_to_move) || illegal_castling) {
-		undo_move();
-		return false;
-	}
+	set_check_info();
+}
 
-	if (enpassant_square != NO_SQUARE) {
-		position_key ^= Zobrist::enpassant_square[enpassant_square & 7];
-		enpassant_square = NO_SQUARE;
+/*
+ * Returns the position key after making the move,
+ * without making it. Used to prefetch the hash table.
+ */
+Key Position::key_after(Move move) const {
+	int from = move.get_from();
+	int to = move.get_to();
+	int moved_piece = board_mailbox[from];
+	int placed_piece = move.is_promotion() ? move.get_promoted_piece() : moved_piece;
+
+	Key key = state->position_key ^ Zobrist::black_to_move;
+	key ^= Zobrist::pieces[moved_piece + side_to_move * 6][from];
+	key ^= Zobrist::pieces[placed_piece + side_to_move * 6][to];
+
+	// Capture
+	if (move.is_capture()) {
+		if (move.is_enpassant())
+			key ^= Zobrist::pieces[PAWN + ~side_to_move * 6][state->enpassant_square - 8 + side_to_move * 16];
+		else
+			key ^= Zobrist::pieces[board_mailbox[to] + ~side_to_move * 6][to];
 	}
-	if (move.is_double_pawn_push()) {
-		enpassant_square = to + 8 - side_to_move * 16;
-		position_key ^= Zobrist::enpassant_square[enpassant_square & 7];
+
+	// Castling
+	if (move.is_castling()) {
+		int rook_from = to + 1;
+		int rook_to = to - 1;
+		if (to - from < 0) { // Queen castling
+			rook_from = to - 2;
+			rook_to = to + 1;
+		}
+		key ^= Zobrist::pieces[ROOK + side_to_move * 6][rook_from];
+		key ^= Zobrist::pieces[ROOK + side_to_move * 6][rook_to];
 	}
 
-	position_key ^= Zobrist::black_to_move; // remove it or add it depending on side to move
+	// Enpassant square
+	if (state->enpassant_square != NO_SQUARE)
+		key ^= Zobrist::enpassant_square[state->enpassant_square & 7];
+	if (move.is_double_pawn_push())
+		key ^= Zobrist::enpassant_square[to & 7];
 
-	position_key ^= Zobrist::castling_rights[castling_rights];
-	castling_rights &= CASTLING_RIGHT_UPDATE[from];
-	castling_rights &= CASTLING_RIGHT_UPDATE[to];
-	position_key ^= Zobrist::castling_rights[castling_rights];
+	// Castling rights
+	int new_castling_rights = state->castling_rights & CASTLING_RIGHT_UPDATE[from] & CASTLING_RIGHT_UPDATE[to];
+	key ^= Zobrist::castling_rights[state->castling_rights] ^ Zobrist::castling_rights[new_castling_rights];
 
-	return true;
+	return key;
 }
 
 /*
@@ -506,47 +645,422 @@ bool Position::is_attacked(int square, Color side) const {
 			(Attacks::get_rook_attacks(occupied, square) & (piece_bitboards[side][ROOK] | piece_bitboards[side][QUEEN]));
 }
 
+/*
+ * Returns true if the move could have been generated in this
+ * position. Used to check moves that don't come from the move
+ * generator (hash moves and killers) before making them.
+ */
+bool Position::is_pseudo_legal(Move move) const {
+	// Null move and unused flag combinations
+	int flags = move.get_move() >> 12;
+	if (move.is_null() || flags == 3 || flags == 6 || flags == 7)
+		return false;
+
+	int from = move.get_from();
+	int to = move.get_to();
+	Bitboard to_bb = 1ULL << to;
+	Bitboard occupied = occupied_squares[WHITE] | occupied_squares[BLACK];
+
+	if (!((occupied_squares[side_to_move] >> from) & 1) || (occupied_squares[side_to_move] & to_bb))
+		return false;
+
+	int piece = board_mailbox[from];
+
+	// Capture flag must match the target square
+	if (move.is_enpassant()) {
+		if (piece != PAWN || to != state->enpassant_square)
+			return false;
+		return Attacks::pawn_attacks[side_to_move][from] & to_bb;
+	}
+	if (move.is_capture() != bool(occupied_squares[~side_to_move] & to_bb))
+		return false;
+
+	if (piece == PAWN) {
+		int forward = side_to_move == WHITE ? NORTH : SOUTH;
+		bool last_rank = (to >> 3) == (side_to_move == WHITE ? RANK_8 : RANK_1);
+		if (move.is_promotion() != last_rank || move.is_castling())
+			return false;
+		if (move.is_capture())
+			return Attacks::pawn_attacks[side_to_move][from] & to_bb;
+		if (move.is_double_pawn_push())
+			return (from >> 3) == (side_to_move == WHITE ? RANK_2 : RANK_7) && to == from + 2 * forward
+					&& !((occupied >> (from + forward)) & 1);
+		return to == from + forward;
+	}
+
+	if (move.is_promotion() || move.is_double_pawn_push())
+		return false;
+
+	if (move.is_castling()) {
+		// Same conditions as the move generator, is_legal checks the rest
+		int king_square = side_to_move == WHITE ? E1 : E8;
+		if (piece != KING || from != king_square)
+			return false;
+		if (to == king_square + 2)
+			return !(occupied & (3ULL << (king_square + 1))) && ((piece_bitboards[side_to_move][ROOK] >> (king_square + 3)) & 1);
+		if (to == king_square - 2)
+			return !(occupied & (7ULL << (king_square - 3))) && ((piece_bitboards[side_to_move][ROOK] >> (king_square - 4)) & 1);
+		return false;
+	}
+
+	switch (piece) {
+	case KNIGHT: return Attacks::knight_attacks[from] & to_bb;
+	case BISHOP: return Attacks::get_bishop_attacks(occupied, from) & to_bb;
+	case ROOK: return Attacks::get_rook_attacks(occupied, from) & to_bb;
+	case QUEEN: return Attacks::get_queen_attacks(occupied, from) & to_bb;
+	case KING: return Attacks::king_attacks[from] & to_bb;
+	}
+	return false;
+}
+
+/*
+ * Returns true if a pseudo-legal move doesn't leave the king
+ * in check. Castling also needs the right and a king path
+ * that is not attacked.
+ */
+bool Position::is_legal(Move move) const {
+	int from = move.get_from();
+	int to = move.get_to();
+
+	if (move.is_castling()) {
+		int needed_right = side_to_move == WHITE ? WHITE_SHORT : BLACK_SHORT;
+		if (to < from)
+			needed_right = side_to_move == WHITE ? WHITE_LONG : BLACK_LONG;
+		int step = to > from ? 1 : -1;
+		return (state->castling_rights & needed_right) &&
+				!is_attacked(from, ~side_to_move) &&
+				!is_attacked(from + step, ~side_to_move) &&
+				!is_attacked(to, ~side_to_move);
+	}
+
+	Bitboard occupied = occupied_squares[WHITE] | occupied_squares[BLACK];
+	int king_square = Bitboards::bit_scan_forward(piece_bitboards[side_to_move][KING]);
+
+	// Enpassant removes two pieces from the lines to the king, test the position after the move
+	if (move.is_enpassant()) {
+		Bitboard captured = 1ULL << (to - 8 + side_to_move * 16);
+		occupied = (occupied ^ (1ULL << from) ^ captured) | (1ULL << to);
+		return !(attackers_to(king_square, occupied) & occupied_squares[~side_to_move] & ~captured);
+	}
+
+	// The king can't move to an attacked square, or hide from a slider behind itself
+	if (board_mailbox[from] == KING)
+		return !(attackers_to(to, occupied ^ (1ULL << from)) & occupied_squares[~side_to_move]);
+
+	// In check, other pieces have to capture the checker or block the check
+	if (state->checkers) {
+		if (state->checkers & (state->checkers - 1))
+			return false;
+		if (!((state->checkers | Bitboards::between_bb[king_square][Bitboards::bit_scan_forward(state->checkers)]) & (1ULL << to)))
+			return false;
+	}
+
+	// A pinned piece can only move along the line of the pin
+	return !(get_pinned() & (1ULL << from)) || (Bitboards::line_bb[king_square][from] & (1ULL << to));
+}
+
+/*
+ * Returns true if the legal move gives check: directly, by
+ * discovering a slider, or by the special moves (promotion,
+ * enpassant and the castling rook).
+ */
+bool Position::gives_check(Move move) const {
+	int from = move.get_from();
+	int to = move.get_to();
+	int enemy_king_square = Bitboards::bit_scan_forward(piece_bitboards[~side_to_move][KING]);
+
+	// Direct check
+	if (state->check_squares[board_mailbox[from]] & (1ULL << to))
+		return true;
+
+	// Discovered check, unless the piece stays on the line to the king
+	if ((state->blockers_for_king[~side_to_move] & (1ULL << from)) &&
+			!(Bitboards::line_bb[enemy_king_square][from] & (1ULL << to)))
+		return true;
+
+	Bitboard occupied = (occupied_squares[WHITE] | occupied_squares[BLACK]) ^ (1ULL << from);
+	Bitboard rooks = piece_bitboards[side_to_move][ROOK] | piece_bitboards[side_to_move][QUEEN];
+	Bitboard bishops = piece_bitboards[side_to_move][BISHOP] | piece_bitboards[side_to_move][QUEEN];
+
+	if (move.is_promotion()) {
+		occupied |= 1ULL << to;
+		switch (move.get_promoted_piece()) {
+		case KNIGHT: return Attacks::knight_attacks[to] & (1ULL << enemy_king_square);
+		case BISHOP: return Attacks::get_bishop_attacks(occupied, to) & (1ULL << enemy_king_square);
+		case ROOK: return Attacks::get_rook_attacks(occupied, to) & (1ULL << enemy_king_square);
+		case QUEEN: return Attacks::get_queen_attacks(occupied, to) & (1ULL << enemy_king_square);
+		}
+	}
+
+	// The captured pawn may also uncover a slider
+	if (move.is_enpassant()) {
+		occupied = (occupied ^ (1ULL << (to - 8 + side_to_move * 16))) | (1ULL << to);
+		return (Attacks::get_rook_attacks(occupied, enemy_king_square) & rooks) |
+				(Attacks::get_bishop_attacks(occupied, enemy_king_square) & bishops);
+	}
+
+	// The castling rook, with the king already moved
+	if (move.is_castling()) {
+		int rook_from = to > from ? to + 1 : to - 2;
+		int rook_to = to > from ? to - 1 : to + 1;
+		occupied = (occupied ^ (1ULL << rook_from)) | (1ULL << to) | (1ULL << rook_to);
+		return Attacks::get_rook_attacks(occupied, rook_to) & (1ULL << enemy_king_square);
+	}
+	return false;
+}
+
+/*
+ * Returns the pieces of both sides that attack the square,
+ * with the sliding attacks computed over the given occupancy.
+ */
+Bitboard Position::attackers_to(int square, Bitboard occupied) const {
+	return
+			(Attacks::knight_attacks[square] & (piece_bitboards[WHITE][KNIGHT] | piece_bitboards[BLACK][KNIGHT])) |
+			(Attacks::king_attacks[square] & (piece_bitboards[WHITE][KING] | piece_bitboards[BLACK][KING])) |
+			(Attacks::pawn_attacks[BLACK][square] & piece_bitboards[WHITE][PAWN]) |
+			(Attacks::pawn_attacks[WHITE][square] & piece_bitboards[BLACK][PAWN]) |
+			(Attacks::get_bishop_attacks(occupied, square) & (piece_bitboards[WHITE][BISHOP] | piece_bitboards[BLACK][BISHOP] |
+					piece_bitboards[WHITE][QUEEN] | piece_bitboards[BLACK][QUEEN])) |
+			(Attacks::get_rook_attacks(occupied, square) & (piece_bitboards[WHITE][ROOK] | piece_bitboards[BLACK][ROOK] |
+					piece_bitboards[WHITE][QUEEN] | piece_bitboards[BLACK][QUEEN]));
+}
+
+/*
+ * Removes the least valuable piece of the side that attacks the square
+ * from the occupancy and returns its type, or EMPTY if there is none.
+ * The sliders that were behind it (x-rays) join the attackers.
+ */
+int Position::pop_least_valuable_attacker(int square, Color side, Bitboard &occupied, Bitboard &attackers) const {
+	constexpr Piece_type by_value[] = {PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING};
+	Bitboard side_attackers = attackers & occupied & occupied_squares[side];
+	if (!side_attackers)
+		return EMPTY;
+	for (Piece_type piece : by_value) {
+		Bitboard b = side_attackers & piece_bitboards[side][piece];
+		if (!b)
+			continue;
+		occupied ^= b & -b;
+		if (piece == PAWN || piece == BISHOP || piece == QUEEN)
+			attackers |= Attacks::get_bishop_attacks(occupied, square) & (piece_bitboards[WHITE][BISHOP] | piece_bitboards[BLACK][BISHOP] |
+					piece_bitboards[WHITE][QUEEN] | piece_bitboards[BLACK][QUEEN]);
+		if (piece == ROOK || piece == QUEEN)
+			attackers |= Attacks::get_rook_attacks(occupied, square) & (piece_bitboards[WHITE][ROOK] | piece_bitboards[BLACK][ROOK] |
+					piece_bitboards[WHITE][QUEEN] | piece_bitboards[BLACK][QUEEN]);
+		return piece;
+	}
+	return EMPTY;
+}
+
+/*
+ * Static exchange evaluation: material balance of the sequence of
+ * captures on the destination square of the move, each side capturing
+ * with its least valuable piece and free to stop when it loses material.
+ * Pins are ignored. Castling and promotions count as 0.
+ */
+int Position::see(Move move) const {
+	if (move.is_castling() || move.is_promotion())
+		return 0;
+	int from = move.get_from();
+	int to = move.get_to();
+	Bitboard occupied = (occupied_squares[WHITE] | occupied_squares[BLACK]) ^ (1ULL << from);
+	int captured = board_mailbox[to];
+	if (move.is_enpassant()) {
+		captured = PAWN;
+		occupied ^= 1ULL << (to - 8 + side_to_move * 16);
+	}
+
+	// Speculative gains of each capture, from the side making it
+	int gain[32];
+	int depth = 0;
+	gain[0] = Evaluation::get_piece_value(captured);
+	int piece_on_square = board_mailbox[from];
+	Bitboard attackers = attackers_to(to, occupied);
+	Color side = ~side_to_move;
+	while (true) {
+		int piece = pop_least_valuable_attacker(to, side, occupied, attackers);
+		// The king can't capture a defended piece
+		if (piece == EMPTY || (piece == KING && (attackers & occupied & occupied_squares[~side])))
+			break;
+		depth++;
+		gain[depth] = Evaluation::get_piece_value(piece_on_square) - gain[depth - 1];
+		piece_on_square = piece;
+		side = ~side;
+	}
+
+	// Each side stops capturing when it doesn't pay
+	while (depth > 0) {
+		gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+		depth--;
+	}
+	return gain[0];
+}
+
+/*
+ * Returns true if the static exchange evaluation of the move
+ * is at least the threshold. Faster than see(): it stops as soon
+ * as the result can't change sides of the threshold.
+ */
+bool Position::see_ge(Move move, int threshold) const {
+	if (move.is_castling() || move.is_promotion())
+		return 0 >= threshold;
+	int from = move.get_from();
+	int to = move.get_to();
+	Bitboard occupied = (occupied_squares[WHITE] | occupied_squares[BLACK]) ^ (1ULL << from);
+	int captured = board_mailbox[to];
+	if (move.is_enpassant()) {
+		captured = PAWN;
+		occupied ^= 1ULL << (to - 8 + side_to_move * 16);
+	}
+
+	// Balance if the opponent doesn't recapture, and if it recaptures for free
+	int swap = Evaluation::get_piece_value(captured) - threshold;
+	if (swap < 0)
+		return false;
+	swap = Evaluation::get_piece_value(board_mailbox[from]) - swap;
+	if (swap <= 0)
+		return true;
+
+	Bitboard attackers = attackers_to(to, occupied);
+	Color side = side_to_move;
+	bool result = true;
+	while (true) {
+		side = ~side;
+		int piece = pop_least_valuable_attacker(to, side, occupied, attackers);
+		if (piece == EMPTY)
+			break;
+		// The king can't capture a defended piece
+		if (piece == KING)
+			return (attackers & occupied & occupied_squares[~side]) ? result : !result;
+		result = !result;
+		swap = Evaluation::get_piece_value(piece) - swap;
+		if (swap < result)
+			break;
+	}
+	return result;
+}
+
 /*
  * Returns true if the current position has already appear.
+ * Only the states with the same side to move since the last
+ * irreversible move or null move are compared.
  */
 bool Position::is_repetition() const {
-	for (int i = history_ply - fifty_count; i < history_ply; i++) {
-		if (position_key == moves_history[i].position_key)
+	int end = std::min(state->fifty_count, state->plies_from_null);
+	const State_info *previous_state = state;
+	for (int i = 2; i <= end; i += 2) {
+		previous_state = previous_state->previous->previous;
+		if (previous_state->position_key == state->position_key)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Returns true if the side to move has a move that repeats a
+ * position of the search, so it can at least draw. Each earlier
+ * position is found by its key difference with the current one
+ * in the cuckoo table. Positions from before the search root
+ * are not used, a single repetition of them is not a draw.
+ * Pins and checks are ignored.
+ */
+bool Position::has_upcoming_repetition() const {
+	int end = std::min(std::min(state->fifty_count, state->plies_from_null), search_ply - 1);
+	if (end < 3)
+		return false;
+
+	Bitboard occupied = occupied_squares[WHITE] | occupied_squares[BLACK];
+	const State_info *previous_state = state->previous;
+	for (int i = 3; i <= end; i += 2) {
+		previous_state = previous_state->previous->previous;
+		Key move_key = state->position_key ^ previous_state->position_key;
+		int slot = Cuckoo::first_slot(move_key);
+		if (Cuckoo::table.keys[slot] != move_key) {
+			slot = Cuckoo::second_slot(move_key);
+			if (Cuckoo::table.keys[slot] != move_key)
+				continue;
+		}
+		// The piece must be ours and its path free
+		int from = Cuckoo::table.moves[slot] >> 6;
+		int to = Cuckoo::table.moves[slot] & 0x3f;
+		if (!(Bitboards::between_bb[from][to] & occupied) && (occupied_squares[side_to_move] & ((1ULL << from) | (1ULL << to))))
 			return true;
 	}
 	return false;
 }
 
 /*
- * Returns true if the side to move is in check.
+ * Computes the check info of the state: checkers, the blockers
+ * and pinners of both kings, and the squares where each piece
+ * of the side to move would give check.
  */
-bool Position::in_check() const {
+void Position::set_check_info() {
+	Bitboard occupied = occupied_squares[WHITE] | occupied_squares[BLACK];
 	int king_square = Bitboards::bit_scan_forward(piece_bitboards[side_to_move][KING]);
-	return is_attacked(king_square, ~side_to_move);
+	state->checkers = attackers_to(king_square, occupied) & occupied_squares[~side_to_move];
+	set_slider_blockers(WHITE);
+	set_slider_blockers(BLACK);
+
+	int enemy_king_square = Bitboards::bit_scan_forward(piece_bitboards[~side_to_move][KING]);
+	state->check_squares[PAWN] = Attacks::pawn_attacks[~side_to_move][enemy_king_square];
+	state->check_squares[KNIGHT] = Attacks::knight_attacks[enemy_king_square];
+	state->check_squares[BISHOP] = Attacks::get_bishop_attacks(occupied, enemy_king_square);
+	state->check_squares[ROOK] = Attacks::get_rook_attacks(occupied, enemy_king_square);
+	state->check_squares[QUEEN] = state->check_squares[BISHOP] | state->check_squares[ROOK];
+	state->check_squares[KING] = 0;
+}
+
+/*
+ * Computes the pieces (of any side) alone between the king of the
+ * side and an enemy slider, and the enemy sliders that pin a piece.
+ */
+void Position::set_slider_blockers(Color side) {
+	Bitboard occupied = occupied_squares[WHITE] | occupied_squares[BLACK];
+	int king_square = Bitboards::bit_scan_forward(piece_bitboards[side][KING]);
+	Bitboard queens = piece_bitboards[~side][QUEEN];
+	Bitboard snipers = (Attacks::get_rook_attacks(0, king_square) & (piece_bitboards[~side][ROOK] | queens)) |
+			(Attacks::get_bishop_attacks(0, king_square) & (piece_bitboards[~side][BISHOP] | queens));
+	state->blockers_for_king[side] = 0;
+	state->pinners[~side] = 0;
+	while (snipers) {
+		int sniper_square = Bitboards::bit_scan_forward(snipers);
+		Bitboard blockers = Bitboards::between_bb[king_square][sniper_square] & occupied;
+		if (blockers && !(blockers & (blockers - 1))) {
+			state->blockers_for_king[side] |= blockers;
+			if (blockers & occupied_squares[side])
+				state->pinners[~side] |= 1ULL << sniper_square;
+		}
+		snipers &= snipers - 1;
+	}
 }
 
 /*
  * Returns true if the position is in the endgame (based on material).
  */
 bool Position::endgame() const {
-	return material[WHITE] < 900 + Evaluation::get_piece_value(KING);
+	return get_material(WHITE) < 900 + Evaluation::get_piece_value(KING);
 }
 
 /*
  * Makes a null move for the null move pruning.
  */
-void Position::make_null_move() {
-	moves_history[history_ply].position_key = position_key;
-	moves_history[history_ply].enpassant_square = enpassant_square;
-	if (enpassant_square != NO_SQUARE) {
-		position_key ^= Zobrist::enpassant_square[enpassant_square % 8];
-		enpassant_square = NO_SQUARE;
+void Position::make_null_move(State_info &new_state) {
+	new_state = *state;
+	new_state.previous = state;
+	new_state.move = Move();
+	new_state.captured_piece = EMPTY;
+	new_state.plies_from_null = 0;
+	state = &new_state;
+
+	if (state->enpassant_square != NO_SQUARE) {
+		state->position_key ^= Zobrist::enpassant_square[state->enpassant_square % 8];
+		state->enpassant_square = NO_SQUARE;
 	}
 	history_ply++;
 	search_ply++;
-	position_key ^= Zobrist::black_to_move;
+	state->position_key ^= Zobrist::black_to_move;
 
 	side_to_move = ~side_to_move;
+	set_check_info();
 }
 
 /*
@@ -554,8 +1068,7 @@ void Position::make_null_move() {
  */
 void Position::undo_null_move() {
 	history_ply--;
-	position_key = moves_history[history_ply].position_key;
-	enpassant_square = moves_history[history_ply].enpassant_square;
+	state = state->previous;
 	search_ply--;
 
 	side_to_move = ~side_to_move;
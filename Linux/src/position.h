@@ -32,6 +32,36 @@
 // Constants
 const std::string INITIAL_POSITION_FEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 
+/*
+ * Zobrist Hashing.
+ */
+namespace Zobrist {
+	// Seed for the random keys, saved hash tables depend on it
+	constexpr unsigned int ZOBRIST_SEED = 3596592594u;
+}
+
+/*
+ * Irreversible aspects of a position and the info computed once
+ * per move. Every make_move gets a new state from the caller
+ * (usually on the search stack) linked to the previous one,
+ * so undoing a move only has to step back to it.
+ */
+struct State_info {
+	Key position_key;
+	Key pawns_key;
+	int fifty_count;
+	int castling_rights;
+	int enpassant_square;
+	int plies_from_null; // plies since the root or the last null move
+	Bitboard checkers; // pieces giving check to the side to move
+	Bitboard blockers_for_king[PLAYERS]; // pieces of any side alone between each king and an enemy slider
+	Bitboard pinners[PLAYERS]; // sliders of each side pinning an enemy piece to its king
+	Bitboard check_squares[PIECE_TYPES / PLAYERS]; // squares where each piece type of the side to move gives check
+	Move move; // move that led to this state
+	int captured_piece;
+	State_info *previous;
+};
+
 /*
  * Class that represents a position on the board.
  */
@@ -40,9 +70,8 @@ public:
 
 	// Default: Initial Position.
 	Position(const std::string fen = INITIAL_POSITION_FEN);
-
-	// Initialization for Zobrist Hashing
-	static void init();
+	Position(const Position &other);
+	Position &operator=(const Position &other);
 
 	// Position representation
 	Bitboard get_piece_bitboard(Color side, Piece_type piece_type) const;
@@ -56,25 +85,41 @@ public:
 	int get_history_ply() const;
 	int get_search_ply() const;
 	int get_material(Color side) const;
+	Score get_psq_score(Color side) const;
 	Bitboard get_occupancy() const;
 	Bitboard get_empty_squares() const;
 	int get_piece(int square) const;
+	Bitboard get_checkers() const;
+	Bitboard get_pinned() const;
+	Bitboard get_blockers_for_king(Color side) const;
+	Bitboard get_pinners(Color side) const;
+	Bitboard get_check_squares(Piece_type piece_type) const;
 
 	// FEN Notation
 	void load_FEN(std::string s);
 
 	// Doing and undoing moves
-	bool make_move(Move &move);
+	void make_move(Move move, State_info &new_state);
+	Key key_after(Move move) const;
+	bool is_pseudo_legal(Move move) const;
+	bool is_legal(Move move) const;
+	bool gives_check(Move move) const;
 	void undo_move();
-	void make_null_move();
+	void make_null_move(State_info &new_state);
 	void undo_null_move();
 
 	// Attacks
 	bool is_attacked(int square, Color side) const;
+	Bitboard attackers_to(int square, Bitboard occupied) const;
 	bool in_check() const;
 
+	// Static exchange evaluation
+	int see(Move move) const;
+	bool see_ge(Move move, int threshold) const;
+
 	// Draw detection
 	bool is_repetition() const;
+	bool has_upcoming_repetition() const;
 
 	// Search
 	void reset_search_ply();
@@ -82,9 +127,6 @@ public:
 
 private:
 
-	// Constants
-	static constexpr int MAX_GAME_MOVES = 512;
-
 	/*
 	 * To set flags representing different castling rights.
 	 */
@@ -95,46 +137,32 @@ private:
 		BLACK_LONG = 8
 	};
 
-	/*
-	 * Neccesary info to undo a move.
-	 */
-	struct History_move {
-		Move move;
-		Key position_key;
-		Key pawns_key;
-		int fifty_count;
-		int castling_rights;
-		int enpassant_square;
-		int captured_piece;
-	};
-
 	// Data members
 	Bitboard piece_bitboards[PLAYERS][PIECE_TYPES / PLAYERS];
 	Bitboard occupied_squares[2];
-	Key position_key;
-	Key pawns_key;
 	Color side_to_move;
 	int board_mailbox[SQUARES];
-	int fifty_count;
-	int castling_rights;
-	int enpassant_square;
 	int history_ply;
 	int search_ply;
-	History_move moves_history[MAX_GAME_MOVES];
-	int material[PLAYERS];
+	int material[PLAYERS]; // piece values only, for the game phase
+	Score psq_score[PLAYERS]; // piece values plus piece-square bonus
+	State_info *state;
+	State_info root_state; // state of the loaded FEN, or of the position copied
 
 	// Initialization helpers
 	void set_position_key(int * color);
 	void set_pawns_key(int * color);
 	void init_material(int * color);
+	void set_check_info();
+	void set_slider_blockers(Color side);
+
+	// Static exchange evaluation helper
+	int pop_least_valuable_attacker(int square, Color side, Bitboard &occupied, Bitboard &attackers) const;
 
 	// load_FEN helpers
 	void reset_board();
 	void reset_mailbox();
 	void reset_bitboards();
-
-	// Zobrist hashing
-	static void init_hash_keys();
 };
 
 inline Bitboard Position::get_piece_bitboard(Color side, Piece_type piece_type) const {
@@ -146,11 +174,11 @@ inline Bitboard Position::get_occupied_squares(Color side) const {
 }
 
 inline Key Position::get_position_key() const {
-	return position_key;
+	return state->position_key;
 }
 
 inline Key Position::get_pawns_key() const {
-	return pawns_key;
+	return state->pawns_key;
 }
 
 inline Color Position::get_side_to_move() const {
@@ -158,15 +186,15 @@ inline Color Position::get_side_to_move() const {
 }
 
 inline int Position::get_fifty_count() const {
-	return fifty_count;
+	return state->fifty_count;
 }
 
 inline int Position::get_castling_rights() const {
-	return castling_rights;
+	return state->castling_rights;
 }
 
 inline int Position::get_enpassant_square() const {
-	return enpassant_square;
+	return state->enpassant_square;
 }
 
 inline int Position::get_history_ply() const {
@@ -181,6 +209,10 @@ inline int Position::get_material(Color side) const {
 	return material[side];
 }
 
+inline Score Position::get_psq_score(Color side) const {
+	return psq_score[side];
+}
+
 inline Bitboard Position::get_occupancy() const {
 	return occupied_squares[WHITE] | occupied_squares[BLACK];
 }
@@ -193,6 +225,30 @@ inline int Position::get_piece(int square) const {
 	return board_mailbox[square];
 }
 
+inline Bitboard Position::get_checkers() const {
+	return state->checkers;
+}
+
+inline Bitboard Position::get_pinned() const {
+	return state->blockers_for_king[side_to_move] & occupied_squares[side_to_move];
+}
+
+inline Bitboard Position::get_blockers_for_king(Color side) const {
+	return state->blockers_for_king[side];
+}
+
+inline Bitboard Position::get_pinners(Color side) const {
+	return state->pinners[side];
+}
+
+inline Bitboard Position::get_check_squares(Piece_type piece_type) const {
+	return state->check_squares[piece_type];
+}
+
+inline bool Position::in_check() const {
+	return state->checkers;
+}
+
 inline void Position::reset_search_ply() {
 	search_ply = 0;
 }
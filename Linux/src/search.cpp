@@ -22,31 +22,19 @@
 
 #include <iostream>
 #include <climits>
+#include <thread>
+#include <vector>
+#include <algorithm>
 
 #include "search.h"
 #include "movegenerator.h"
+#include "movepicker.h"
 #include "evaluation.h"
 #include "timemanagement.h"
 #include "transpositiontable.h"
 
 namespace Search {
 
-	// Move ordering
-	/*
-	 * Killer heuristic.
-	 */
-	const int killer_score = 1024;
-	unsigned int killer_moves[2][MAX_DEPTH];
-	/*
-	 * History heuristic.
-	 */
-	int search_history[SQUARES][SQUARES];
-
-	/*
-	 * PV Move.
-	 */
-	const int pv_score = 5000;
-
 	// Delta pruning
 	const int safety_margin = 200;
 	const int max_delta = 900;
@@ -57,12 +45,19 @@ namespace Search {
 	// Null move pruning
 	const int R = 2;
 
+	// Lazy SMP
+	int search_threads = MIN_THREADS;
+	std::vector<Search_thread> threads;
+
 	// Helpers
-	void clear_search(Position &pos);
-	void send_search_iteration_info(int score, int current_depth, Search_info &search_info);
-	int alpha_beta(Position &pos, int alpha, int beta, int depth, Search_info &search_info, bool null_move_pruning);
+	void clear_search(Search_thread &thread);
+	void helper_search(Search_thread &thread, Search_info &search_info);
+	long long get_total_nodes();
+	void increment_nodes(Search_thread &thread);
+	void send_search_iteration_info(int score, int current_depth, Search_thread &thread, Search_info &search_info);
+	int alpha_beta(Search_thread &thread, int alpha, int beta, int depth, Search_info &search_info, bool null_move_pruning);
 	void set_next_move(MoveGen::Move_list &move_list, int move_num);
-	int quiescence_search(Position &pos, int alpha, int beta, Search_info &search_info);
+	int quiescence_search(Search_thread &thread, int alpha, int beta, Search_info &search_info);
 
 	/*
 	 * Seach the position to a certain depth
@@ -72,7 +67,19 @@ namespace Search {
 	 */
 	void search(Position &pos, Search_info &search_info) {
 		Move best_move;
-		clear_search(pos);
+		Move ponder_move;
+		new_search();
+
+		// Every thread searches its own copy of the position
+		// Search_thread can't be moved (atomic counter), so the vector is rebuilt instead of resized
+		if ((int)threads.size() != search_threads)
+			threads = std::vector<Search_thread>(search_threads);
+		for (int i = 0; i < search_threads; i++) {
+			threads[i].id = i;
+			threads[i].pos = pos;
+			clear_search(threads[i]);
+		}
+		Search_thread &main_thread = threads[0];
 
 		if (search_info.depth == 0)
 			search_info.depth = MAX_DEPTH;
@@ -80,63 +87,139 @@ namespace Search {
 		int alpha = -MATE_SCORE - 100;
 		int beta = MATE_SCORE + 100;
 
+		// Start the helper threads
+		std::vector<std::thread> helpers;
+		for (int i = 1; i < search_threads; i++)
+			helpers.push_back(std::thread(helper_search, std::ref(threads[i]), std::ref(search_info)));
+
 		// Iterative deepening
 		for (int current_depth = 1; current_depth <= search_info.depth; current_depth++) {
 			// Iteration score
-		    int score = alpha_beta(pos, alpha, beta, current_depth, search_info, true);
+		    int score = alpha_beta(main_thread, alpha, beta, current_depth, search_info, true);
 
 		    // Check for timeout
-			if (Time::time_out(search_info.start_time, search_info.time_to_search) || search_info.stop)
+			if (Time::time_out(search_info.start_time, search_info.time_to_search) || search_info.stop.load(std::memory_order_relaxed))
 		    	break; // the iteration didn't finish, ignore the values
 
-			// Load the principal variation line and the best move
-		    load_pv_line(current_depth, pos);
-		    best_move = principal_variation.moves[0];
+			// Best move and ponder move from the principal variation
+		    best_move = main_thread.pv_table[0][0];
+		    ponder_move = main_thread.pv_length[0] > 1 ? main_thread.pv_table[0][1] : Move();
 
 		    // Print info for UCI Protocol
-		    send_search_iteration_info(score, current_depth, search_info);
+		    send_search_iteration_info(score, current_depth, main_thread, search_info);
 
 		    // Check time before starting a new iteration
 		    if (!Time::time_for_next_iteration(search_info.start_time, search_info.time_to_search))
 		    	break;
 		}
+		// Stop the helper threads
+		search_info.stop.store(true, std::memory_order_relaxed);
+		for (std::thread &helper : helpers)
+			helper.join();
+
 		// Send best move found
-		std::cout << "bestmove " << best_move.long_algebraic_notation() << std::endl;
+		std::cout << "bestmove " << best_move.long_algebraic_notation();
+		if (!ponder_move.is_null())
+			std::cout << " ponder " << ponder_move.long_algebraic_notation();
+		std::cout << std::endl;
+	}
+
+	/*
+	 * Iterative deepening for a helper thread.
+	 * Helpers don't report anything, they only fill the shared
+	 * transposition table. Odd threads start one ply deeper
+	 * so that not every thread searches the same tree.
+	 */
+	void helper_search(Search_thread &thread, Search_info &search_info) {
+		int alpha = -MATE_SCORE - 100;
+		int beta = MATE_SCORE + 100;
+
+		for (int current_depth = 1 + (thread.id & 1); current_depth <= search_info.depth; current_depth++) {
+			alpha_beta(thread, alpha, beta, current_depth, search_info, true);
+			if (Time::time_out(search_info.start_time, search_info.time_to_search) || search_info.stop.load(std::memory_order_relaxed))
+				break;
+		}
+	}
+
+	/*
+	 * Clears the hash tables and the move ordering
+	 * tables of every thread.
+	 */
+	void clear() {
+		// The table is cleared with every core, not only the search threads
+		int clear_threads = std::min<int>(std::max(1u, std::thread::hardware_concurrency()), MAX_THREADS);
+		clear_hash_table(clear_threads);
+		for (Search_thread &thread : threads) {
+			clear_search(thread);
+			std::fill(thread.pawns_hash_table.begin(), thread.pawns_hash_table.end(), Evaluation::Pawn_hash_entry());
+		}
+	}
+
+	/*
+	 * Sets the number of threads used by the search.
+	 */
+	void set_threads(int threads) {
+		if (threads < MIN_THREADS)
+			threads = MIN_THREADS;
+		if (threads > MAX_THREADS)
+			threads = MAX_THREADS;
+		search_threads = threads;
+	}
+
+	/*
+	 * Counts a node. Only the owner thread writes its counter,
+	 * so a relaxed load and store is enough, without a locked add.
+	 */
+	inline void increment_nodes(Search_thread &thread) {
+		thread.nodes.store(thread.nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	/*
+	 * Returns the nodes searched by all the threads.
+	 */
+	long long get_total_nodes() {
+		long long nodes = 0;
+		for (Search_thread &thread : threads)
+			nodes += thread.nodes.load(std::memory_order_relaxed);
+		return nodes;
 	}
 
 	/*
 	 * Clear the arrays for killer moves and
-	 * history heuristic; also resets the search ply.
+	 * history heuristic; also resets the search ply
+	 * and the nodes counter.
 	 */
-	void clear_search(Position &pos) {
+	void clear_search(Search_thread &thread) {
 		for (int i = 0; i < SQUARES; i++) {
 			for (int j = 0; j < SQUARES; j++) {
-				search_history[i][j] = 0;
+				thread.search_history[i][j] = 0;
 			}
 		}
-		for (int i = 0; i < MAX_DEPTH; i++) {
-			killer_moves[0][i] = 0;
-			killer_moves[1][i] = 0;
+		for (int i = 0; i < MAX_PLY; i++) {
+			thread.killer_moves[0][i] = 0;
+			thread.killer_moves[1][i] = 0;
+			thread.pv_length[i] = 0;
 		}
-		pos.reset_search_ply();
+		thread.nodes.store(0, std::memory_order_relaxed);
+		thread.pos.reset_search_ply();
 	}
 
 	/*
 	 * Sends information about a search iteration
 	 * using UCI Protocol.
 	 */
-    void send_search_iteration_info(int score, int depth, Search_info &search_info) {
+    void send_search_iteration_info(int score, int depth, Search_thread &thread, Search_info &search_info) {
     	// UCI command
     	std::cout << "info ";
 
     	// Score
-    	if (abs(score) < MATE_SCORE - MAX_DEPTH)
+    	if (abs(score) < MATE_SCORE - MAX_PLY)
     		// Normal score
     		std::cout << "score cp " << score;
     	else {
     		// Mate score
     		std::cout << "score mate ";
-    		if (score > MATE_SCORE - MAX_DEPTH)
+    		if (score > MATE_SCORE - MAX_PLY)
         		std::cout << (MATE_SCORE - score)/2 + 1;
     		else
     			std::cout << -((MATE_SCORE - score)/2 + 1);
@@ -144,14 +227,16 @@ namespace Search {
     	}
     	// General info
     	std::cout << " depth " << depth;
-    	std::cout << " nodes " << search_info.nodes;
+    	long long nodes = get_total_nodes();
+    	std::cout << " nodes " << nodes;
 	    long long searched_time = Time::get_current_time_in_milliseconds() - search_info.start_time;
     	std::cout << " time " << searched_time;
+    	std::cout << " nps " << (nodes * 1000) / (searched_time > 0 ? searched_time : 1);
 
     	// Print principal variation
 	    std::cout << " pv ";
-	    for (int i = 0; i < principal_variation.pv_length; i++) {
-	    	std::cout << principal_variation.moves[i].long_algebraic_notation() << " ";
+	    for (int i = 0; i < thread.pv_length[0]; i++) {
+	    	std::cout << thread.pv_table[0][i].long_algebraic_notation() << " ";
 	    }
 
 	    // Finish
@@ -161,21 +246,34 @@ namespace Search {
     /*
      * Search the position with the alpha beta algorithm.
      */
-	int alpha_beta(Position &pos, int alpha, int beta, int depth, Search_info &search_info, bool null_move_pruning) {
+	int alpha_beta(Search_thread &thread, int alpha, int beta, int depth, Search_info &search_info, bool null_move_pruning) {
+		Position &pos = thread.pos;
+		int ply = pos.get_search_ply();
+		thread.pv_length[ply] = ply;
+
 		// Draw detection
-		if (pos.get_search_ply() > 0 && (pos.get_fifty_count() >= 100 || pos.is_repetition()))
+		if (ply > 0 && (pos.get_fifty_count() >= 100 || pos.is_repetition()))
 			return Evaluation::draw_score;
 
-		// Probe the hash table for a score and a pv move
+		// Upcoming repetition: the side to move can draw by repeating a position
+		if (alpha < Evaluation::draw_score && pos.has_upcoming_repetition()) {
+			alpha = Evaluation::draw_score;
+			if (alpha >= beta)
+				return alpha;
+		}
+
+		// Probe the hash table for a score and a pv move.
+		// PV nodes don't cut with the hash score, so the PV is always complete.
 		Move pv_move;
+		bool pv_node = beta - alpha > 1;
 		int hash_score = probe_hash(pos.get_position_key(), depth, alpha, beta, pv_move);
-		if (hash_score != -1) {
+		if (hash_score != -1 && !pv_node) {
 			return hash_score;
 		}
 
 		// Leaf node
-		if (depth == 0)
-			return quiescence_search(pos, alpha, beta, search_info);
+		if (depth == 0 || ply >= MAX_PLY - 1)
+			return quiescence_search(thread, alpha, beta, search_info);
 
 		bool in_check = pos.in_check();
 		if(in_check) {
@@ -185,33 +283,20 @@ namespace Search {
 		else {
 			// Null move pruning
 			if(null_move_pruning && pos.get_search_ply() > 0 && depth > R && !pos.endgame()) {
-				pos.make_null_move();
-				int score = -alpha_beta(pos, -beta, -beta+1, depth-R, search_info, false);
+				State_info state;
+				pos.make_null_move(state);
+				int score = -alpha_beta(thread, -beta, -beta+1, depth-R, search_info, false);
 				pos.undo_null_move();
-				if (score >= beta && abs(score) < MATE_SCORE - MAX_DEPTH) // @suppress("Invalid arguments")
+				if (score >= beta && abs(score) < MATE_SCORE - MAX_PLY) // @suppress("Invalid arguments")
 					return beta;
 			}
 		}
 
 		// Update search info
-		search_info.nodes++;
-
-	    // Generate moves
-	    MoveGen::Move_list move_list;
-    	generate_moves(pos, move_list);
-
-    	// Set different scores using the pv move, killer move and history heuristic
-    	for (int i = 0; i < move_list.size; i++) {
-    		if (pv_move == move_list.moves[i]) // pv move
-    			move_list.moves[i].set_score(pv_score);
-    		else if (move_list.moves[i].get_move() == killer_moves[0][pos.get_search_ply()]) // killer
-    			move_list.moves[i].set_score(killer_score);
-    		else if (move_list.moves[i].get_move() == killer_moves[1][pos.get_search_ply()]) // killer
-    			move_list.moves[i].set_score(killer_score);
-    		else // history
-    			move_list.moves[i].set_score(search_history[move_list.moves[i].get_from()][move_list.moves[i].get_to()]);
-    	}
+		increment_nodes(thread);
 
+	    // Moves are picked in stages: pv move, captures, killers and history (or evasions in check)
+	    Move_picker move_picker(pos, pv_move, thread.killer_moves[0][ply], thread.killer_moves[1][ply], thread.search_history, in_check);
 
 		// Variables for the search
 		Move best_move;
@@ -221,50 +306,58 @@ namespace Search {
     	int searched_moves = 0;
     	int score;
 	    // Search each move
-	    for (int i = 0; i < move_list.size; i++) {
-	    	set_next_move(move_list, i);
-	    	if (pos.make_move(move_list.moves[i])) {
-	    		legal_moves++;
-	    		// PVS Search
-	    		if (searched_moves == 0) {
-	    			score = -alpha_beta(pos, -beta, -alpha, depth - 1, search_info, true);
-	    		}
-	    		else {
-	    			// Late move reductions
-		    		if ((searched_moves >= 4) & (!in_check) & (!move_list.moves[i].is_capture()) & (depth > 2))
-			    		score = -alpha_beta(pos, -alpha-1, -alpha, depth - 2, search_info, true);
-		    		else
-		    			score = -alpha_beta(pos, -alpha-1, -alpha, depth - 1, search_info, true);
-
-		    		if (score > alpha)
-		    			score = -alpha_beta(pos, -beta, -alpha, depth - 1, search_info, true);
-	    		}
-	    		searched_moves++;
-	        	pos.undo_move();
-	    		// Return if timeout
-	    		if ((search_info.nodes & 2047) == 0) {
-	    			if (Time::time_out(search_info.start_time, search_info.time_to_search) || search_info.stop)
-	    				return -1;
-	    		}
-	    		if (score > max) {
-	    			best_move = move_list.moves[i];
-	    			max = score;
-		    		if (score > alpha) { // Alpha cutoff
-			    		if (score >= beta) { // Beta cutoff
-			    			store_hash(pos.get_position_key(), best_move, beta, depth, HASH_BETA);
-			    			if (!move_list.moves[i].is_capture()) {
-				    			killer_moves[1][pos.get_search_ply()] = killer_moves[0][pos.get_search_ply()];
-				    			killer_moves[0][pos.get_search_ply()] = move_list.moves[i].get_move();
-			    			}
-			    			return beta;
-			    		}
-		    			alpha = score;
-		    			node_type = HASH_EXACT;
-		    			if (!move_list.moves[i].is_capture())
-			    			search_history[move_list.moves[i].get_from()][move_list.moves[i].get_to()] += depth;
-		    		}
-	    		}
-	    	}
+	    Move move;
+	    State_info state;
+	    while (!(move = move_picker.next_move()).is_null()) {
+	    	// Late move reductions: quiet moves and losing captures, except checks
+	    	bool reduce = searched_moves >= 4 && !in_check && depth > 2 && (!move.is_capture() || !pos.see_ge(move, 0))
+	    			&& !pos.gives_check(move);
+	    	prefetch(pos.key_after(move));
+			pos.make_move(move, state);
+			legal_moves++;
+			// PVS Search
+			if (searched_moves == 0) {
+				score = -alpha_beta(thread, -beta, -alpha, depth - 1, search_info, true);
+			}
+			else {
+				if (reduce)
+					score = -alpha_beta(thread, -alpha-1, -alpha, depth - 2, search_info, true);
+				else
+					score = -alpha_beta(thread, -alpha-1, -alpha, depth - 1, search_info, true);
+
+				if (score > alpha)
+					score = -alpha_beta(thread, -beta, -alpha, depth - 1, search_info, true);
+			}
+			searched_moves++;
+			pos.undo_move();
+			// Return if timeout
+			if ((thread.nodes.load(std::memory_order_relaxed) & 2047) == 0) {
+				if (Time::time_out(search_info.start_time, search_info.time_to_search) || search_info.stop.load(std::memory_order_relaxed))
+					return -1;
+			}
+			if (score > max) {
+				best_move = move;
+				max = score;
+				if (score > alpha) { // Alpha cutoff
+					if (score >= beta) { // Beta cutoff
+						store_hash(pos.get_position_key(), best_move, beta, depth, HASH_BETA);
+						if (!move.is_capture()) {
+							thread.killer_moves[1][pos.get_search_ply()] = thread.killer_moves[0][pos.get_search_ply()];
+							thread.killer_moves[0][pos.get_search_ply()] = move.get_move();
+						}
+						return beta;
+					}
+					alpha = score;
+					node_type = HASH_EXACT;
+					// Update the principal variation
+					thread.pv_table[ply][ply] = move;
+					for (int next_ply = ply + 1; next_ply < thread.pv_length[ply + 1]; next_ply++)
+						thread.pv_table[ply][next_ply] = thread.pv_table[ply + 1][next_ply];
+					thread.pv_length[ply] = thread.pv_length[ply + 1];
+					if (!move.is_capture())
+						thread.search_history[move.get_from()][move.get_to()] += depth;
+				}
+			}
 	    }
 
 	    // checkmate or stalemate
@@ -300,9 +393,11 @@ namespace Search {
 	/*
 	 * Expand the search until a quiet position is reached.
 	 */
-	int quiescence_search(Position &pos, int alpha, int beta, Search_info &search_info) {
+	int quiescence_search(Search_thread &thread, int alpha, int beta, Search_info &search_info) {
+		Position &pos = thread.pos;
+
 		// Output info
-		search_info.nodes++;
+		increment_nodes(thread);
 
 		// Draw detection
 		if (Evaluation::insufficient_material(pos))
@@ -316,7 +411,7 @@ namespace Search {
 			return beta;
 
 		// Full evaluation
-		stand_pat += Evaluation::evaluate_positional_factors(pos);
+		stand_pat += Evaluation::evaluate_positional_factors(pos, thread.pawns_hash_table);
 
 		if (stand_pat >= beta)
 			return beta;
@@ -329,16 +424,18 @@ namespace Search {
 		if (alpha < stand_pat)
 			alpha = stand_pat;
 
-		// Generate captures and promotions
+		// Generate captures and promotions, or every evasion when in check
 	    MoveGen::Move_list move_list;
-		if (pos.in_check())
-			generate_moves(pos, move_list); // todo: it would be better to have a special move generator for check evasions
+	    bool in_check = pos.in_check();
+		if (in_check)
+			generate_evasions(pos, move_list);
 		else {
 		    generate_captures(pos, move_list);
 		    generate_promotions(pos, move_list);
 		}
 
 	    // Search each capture
+	    State_info state;
 	    for (int i = 0; i < move_list.size; i++) {
 	    	set_next_move(move_list, i);
 	    	// Delta pruning specific move
@@ -346,22 +443,24 @@ namespace Search {
 		    	int captured_piece = pos.get_piece(move_list.moves[i].get_to());
 	    		if (Evaluation::get_piece_value(captured_piece) + safety_margin + stand_pat < alpha)
 	    			continue;
+	    		// Losing captures are not searched, unless they are evasions
+	    		if (!in_check && !pos.see_ge(move_list.moves[i], 0))
+	    			continue;
 	    	}
-	    	if (pos.make_move(move_list.moves[i])) {
-	    		int score = -quiescence_search(pos, -beta, -alpha, search_info);
-	    		pos.undo_move();
-	    		// Return if timeout
-	    		if ((search_info.nodes & 2047) == 0) {
-	    			if (Time::time_out(search_info.start_time, search_info.time_to_search) || search_info.stop)
-	    				return -1;
-	    		}
-	    		if (score > alpha) {
-		    		if (score >= beta) {
-		    			return beta;
-		    		}
-	    			alpha = score;
-	    		}
-	    	}
+			pos.make_move(move_list.moves[i], state);
+			int score = -quiescence_search(thread, -beta, -alpha, search_info);
+			pos.undo_move();
+			// Return if timeout
+			if ((thread.nodes.load(std::memory_order_relaxed) & 2047) == 0) {
+				if (Time::time_out(search_info.start_time, search_info.time_to_search) || search_info.stop.load(std::memory_order_relaxed))
+					return -1;
+			}
+			if (score > alpha) {
+				if (score >= beta) {
+					return beta;
+				}
+				alpha = score;
+			}
 	    }
 	    return alpha;
 	}
@@ -23,23 +23,52 @@
 #ifndef SRC_SEARCH_H_
 #define SRC_SEARCH_H_
 
+#include <atomic>
+
 #include "position.h"
+#include "pawnhashtable.h"
 
 namespace Search {
 
 	// Constants
 	constexpr int MATE_SCORE = 99000;
 	constexpr int MAX_DEPTH = 32;
+	constexpr int MAX_PLY = 64; // depth plus extensions
+
+	/*
+	 * Search threads limits.
+	 */
+	constexpr int MIN_THREADS = 1;
+	constexpr int MAX_THREADS = 128;
 
 	/*
 	 * Search info struct.
+	 * The stop flag is polled by every search thread.
 	 */
 	struct Search_info {
 		int depth;
 		int time_to_search;
 		long long start_time;
-		long long nodes;
-		bool stop;
+		std::atomic<bool> stop;
+	};
+
+	/*
+	 * Search thread struct.
+	 * Owns everything a search modifies except the
+	 * transposition table, so several threads can search
+	 * at the same time without locks.
+	 */
+	struct Search_thread {
+		int id;
+		Position pos;
+		std::atomic<long long> nodes; // written only by its thread, read by the main thread for the info
+		unsigned int killer_moves[2][MAX_PLY];
+		int search_history[SQUARES][SQUARES];
+		// Triangular PV table: the line found at each ply
+		Move pv_table[MAX_PLY][MAX_PLY];
+		int pv_length[MAX_PLY];
+		Evaluation::Pawn_hash_table pawns_hash_table;
+		Search_thread() : id(0), nodes(0), pawns_hash_table(Evaluation::pawn_hash_table_entries) {};
 	};
 
 	/*
@@ -49,6 +78,19 @@ namespace Search {
 	 * Prints the best move found.
 	 */
 	void search(Position &pos, Search_info &search_info);
+
+	/*
+	 * Clears the transposition table and the tables of every
+	 * search thread (pawns, history and killers) for a new game.
+	 */
+	void clear();
+
+	/*
+	 * Sets the number of threads used by the search.
+	 * The main thread plus (threads - 1) helper threads
+	 * that share the transposition table (Lazy SMP).
+	 */
+	void set_threads(int threads);
 }
 
 #endif /* SRC_SEARCH_H_ */
@@ -20,20 +20,92 @@
  * Author: gonzalo.arro@gmail.com
  */
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <thread>
 #include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "transpositiontable.h"
+#include "search.h"
 
 namespace Search {
 
-	std::vector<Hash_entry> hash_table;
-	PV principal_variation;
+	Hash_cluster *hash_table = nullptr;
+	unsigned long long hash_table_clusters = 0;
+
+	// Memory holding the table
+	void *hash_memory = nullptr;
+	unsigned long long hash_memory_bytes = 0;
+	bool hash_memory_mapped = false; // allocated with mmap
+
+	// Huge pages size
+	constexpr unsigned long long HUGE_PAGE_SIZE = 2 * 0x100000;
+
+	/*
+	 * Header of a saved hash table.
+	 * The table follows the header, starting at a page boundary
+	 * so it can be mapped directly.
+	 */
+	constexpr int HASH_FILE_VERSION = 2;
+	constexpr int HASH_FILE_HEADER_SIZE = 4096;
+	const char HASH_FILE_MAGIC[8] = {'M', 'O', 'R', 'A', 'H', 'A', 'S', 'H'};
+
+	struct Hash_file_header {
+		char magic[8];
+		unsigned int version;
+		unsigned int zobrist_seed;
+		unsigned int entry_size;
+		unsigned int cluster_size;
+		unsigned long long clusters;
+		int generation;
+	};
+
+	/*
+	 * Search generation, increased on each new search.
+	 */
+	constexpr int AGE_MASK = 0x3F;
+	int generation = 0;
+
+	/*
+	 * Scores are stored in 16 bits. Mate scores are
+	 * moved next to the limit of the normal scores.
+	 */
+	constexpr int MAX_HASH_SCORE = 30000;
+	constexpr int HASH_MATE_SCORE = 32000;
+	constexpr int MATE_BAND = 1000;
 
 	// Helpers
-	Move probe_pv_move(Position &pos);
+	bool find_entry(Key key, unsigned long long &data);
+	int replacement_value(unsigned long long data);
+	unsigned int key_check(Key key);
+
+	// Memory management
+	bool allocate_hash_table(unsigned long long bytes);
+	void free_hash_table();
+	void clear_clusters(unsigned long long first, unsigned long long count);
+
+	// Hash entry encoding
+	unsigned long long pack_entry(Key key, Move best_move, int score, int depth, int node_type);
+	unsigned int get_key(unsigned long long data);
+	Move get_best_move(unsigned long long data);
+	int get_score(unsigned long long data);
+	int get_depth(unsigned long long data);
+	int get_node_type(unsigned long long data);
+	int get_age(unsigned long long data);
+	int score_to_hash(int score);
+	int score_from_hash(int score);
 
 	void init() {
-		hash_table.reserve(default_hash_table_entries);
+		set_transposition_table_size(default_hash_table_size);
 	}
 
 	void set_transposition_table_size(int mb) {
@@ -41,26 +113,213 @@ namespace Search {
 			mb = MIN_HASH_SIZE;
 		if (mb > MAX_HASH_SIZE)
 			mb = MAX_HASH_SIZE;
-		int entries = (0x100000 * mb) / sizeof(Hash_entry);
-		std::vector<Hash_entry> temp;
-		temp.reserve(entries);
-		hash_table.clear();
-		hash_table.swap(temp);
+		free_hash_table();
+		// Try smaller sizes if there's not enough memory
+		while (!allocate_hash_table(0x100000ULL * mb) && mb > MIN_HASH_SIZE)
+			mb /= 2;
+		if (hash_table == nullptr) {
+			std::cout << "info string could not allocate the hash table" << std::endl;
+			exit(EXIT_FAILURE);
+		}
 	}
 
 	/*
-	 * Stores a hash entry using "always replace" as the replacement strategy.
+	 * Allocates zeroed memory for the table.
+	 * Uses mmap and asks for transparent huge pages to reduce
+	 * TLB misses, falling back to aligned_alloc. The mapping is
+	 * one huge page larger so the table can start on a huge page
+	 * boundary; hash_memory keeps the mapping itself for munmap.
 	 */
-	void store_hash(Key key, Move best_move, int score, int depth, int node_type) {
-		// Get the corresponding entry
-		Hash_entry &hash_entry = hash_table[key % hash_table.capacity()];
-		// Set the info
-		hash_entry.zobrist_key = key;
-		hash_entry.best_move = best_move;
-		hash_entry.score = score;
-		hash_entry.depth = depth;
-		hash_entry.node_type = node_type;
+	bool allocate_hash_table(unsigned long long bytes) {
+		unsigned long long table_bytes = ((bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE;
+		unsigned long long mapped_bytes = table_bytes + HUGE_PAGE_SIZE;
+		void *memory = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory != MAP_FAILED) {
+			uintptr_t aligned = (reinterpret_cast<uintptr_t>(memory) + HUGE_PAGE_SIZE - 1) & ~(uintptr_t) (HUGE_PAGE_SIZE - 1);
+#ifdef MADV_HUGEPAGE
+			madvise(reinterpret_cast<void*>(aligned), table_bytes, MADV_HUGEPAGE);
+#endif
+			hash_memory = memory;
+			hash_memory_bytes = mapped_bytes;
+			hash_memory_mapped = true;
+			hash_table = reinterpret_cast<Hash_cluster*>(aligned);
+			hash_table_clusters = table_bytes / sizeof(Hash_cluster);
+			return true;
+		}
+		memory = aligned_alloc(sizeof(Hash_cluster), bytes);
+		if (memory != nullptr) {
+			memset(memory, 0, bytes);
+			hash_memory = memory;
+			hash_memory_bytes = bytes;
+			hash_memory_mapped = false;
+			hash_table = static_cast<Hash_cluster*>(memory);
+			hash_table_clusters = bytes / sizeof(Hash_cluster);
+			return true;
+		}
+		return false;
+	}
+
+	/*
+	 * Releases the table memory.
+	 */
+	void free_hash_table() {
+		if (hash_memory != nullptr) {
+			if (hash_memory_mapped)
+				munmap(hash_memory, hash_memory_bytes);
+			else
+				free(hash_memory);
+		}
+		hash_memory = nullptr;
+		hash_memory_bytes = 0;
+		hash_table = nullptr;
+		hash_table_clusters = 0;
+	}
+
+	/*
+	 * Clears the table with several threads. Writing zeros also
+	 * maps the pages, so the first search doesn't pay for it.
+	 */
+	void clear_hash_table(int threads) {
+		unsigned long long chunk = hash_table_clusters / threads;
+		std::vector<std::thread> workers;
+		for (int i = 0; i < threads; i++) {
+			unsigned long long first = i * chunk;
+			unsigned long long count = i == threads - 1 ? hash_table_clusters - first : chunk;
+			workers.push_back(std::thread(clear_clusters, first, count));
+		}
+		for (std::thread &worker : workers)
+			worker.join();
+		generation = 0;
+	}
+
+	/*
+	 * Clears a range of clusters.
+	 */
+	void clear_clusters(unsigned long long first, unsigned long long count) {
+		for (unsigned long long i = first; i < first + count; i++) {
+			for (Hash_entry &entry : hash_table[i].entries)
+				entry.data.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	/*
+	 * Writes the header and the table to the file.
+	 * The table is written to a temporary file that then replaces
+	 * the target, since a loaded table may be backed by the target.
+	 */
+	bool save_hash_table(const std::string &file_name) {
+		if (file_name.empty())
+			return false;
+		std::string temporary_name = file_name + ".tmp";
+		std::ofstream file(temporary_name, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		char header_block[HASH_FILE_HEADER_SIZE] = {};
+		Hash_file_header header = {};
+		memcpy(header.magic, HASH_FILE_MAGIC, sizeof(header.magic));
+		header.version = HASH_FILE_VERSION;
+		header.zobrist_seed = Zobrist::ZOBRIST_SEED;
+		header.entry_size = sizeof(Hash_entry);
+		header.cluster_size = CLUSTER_SIZE;
+		header.clusters = hash_table_clusters;
+		header.generation = generation;
+		memcpy(header_block, &header, sizeof(header));
+
+		file.write(header_block, HASH_FILE_HEADER_SIZE);
+
+		// Entries are copied to a buffer with atomic loads and written in blocks
+		constexpr unsigned long long BLOCK_CLUSTERS = 4096;
+		std::vector<unsigned long long> block(BLOCK_CLUSTERS * CLUSTER_SIZE);
+		for (unsigned long long first = 0; first < hash_table_clusters && file; first += BLOCK_CLUSTERS) {
+			unsigned long long clusters = std::min(BLOCK_CLUSTERS, hash_table_clusters - first);
+			for (unsigned long long i = 0; i < clusters; i++) {
+				for (int j = 0; j < CLUSTER_SIZE; j++)
+					block[i * CLUSTER_SIZE + j] = hash_table[first + i].entries[j].data.load(std::memory_order_relaxed);
+			}
+			file.write(reinterpret_cast<const char*>(block.data()), clusters * sizeof(Hash_cluster));
+		}
+		file.close();
+		if (!file || rename(temporary_name.c_str(), file_name.c_str()) != 0) {
+			remove(temporary_name.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	/*
+	 * Maps a saved table as the transposition table.
+	 * The mapping is private: the search writes to memory,
+	 * the file is only replaced by save_hash_table.
+	 */
+	bool load_hash_table(const std::string &file_name) {
+		int fd = open(file_name.c_str(), O_RDONLY);
+		if (fd == -1)
+			return false;
+
+		// Validate the header
+		Hash_file_header header = {};
+		struct stat file_stat;
+		bool valid = 	fstat(fd, &file_stat) == 0 &&
+						pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+						memcmp(header.magic, HASH_FILE_MAGIC, sizeof(header.magic)) == 0 &&
+						header.version == HASH_FILE_VERSION &&
+						header.zobrist_seed == Zobrist::ZOBRIST_SEED &&
+						header.entry_size == sizeof(Hash_entry) &&
+						header.cluster_size == CLUSTER_SIZE &&
+						header.clusters > 0 &&
+						(unsigned long long) file_stat.st_size == HASH_FILE_HEADER_SIZE + header.clusters * sizeof(Hash_cluster);
+		if (!valid) {
+			close(fd);
+			return false;
+		}
+
+		void *memory = mmap(nullptr, file_stat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (memory == MAP_FAILED)
+			return false;
+
+		free_hash_table();
+		hash_memory = memory;
+		hash_memory_bytes = file_stat.st_size;
+		hash_memory_mapped = true;
+		hash_table = reinterpret_cast<Hash_cluster*>(static_cast<char*>(memory) + HASH_FILE_HEADER_SIZE);
+		hash_table_clusters = header.clusters;
+		generation = header.generation & AGE_MASK;
+		return true;
+	}
 
+	void new_search() {
+		generation = (generation + 1) & AGE_MASK;
+	}
+
+	/*
+	 * Stores a hash entry.
+	 * An entry for the same position is overwritten unless it comes from
+	 * a deeper search of the current generation. Otherwise the entry
+	 * with the lowest replacement value of the cluster is replaced.
+	 */
+	void store_hash(Key key, Move best_move, int score, int depth, int node_type) {
+		Hash_cluster &cluster = get_cluster(key);
+		Hash_entry *replace = &cluster.entries[0];
+		int replace_value = replacement_value(replace->data.load(std::memory_order_relaxed));
+		for (int i = 0; i < CLUSTER_SIZE; i++) {
+			unsigned long long data = cluster.entries[i].data.load(std::memory_order_relaxed);
+			if (data != 0 && get_key(data) == key_check(key)) {
+				if (node_type != HASH_EXACT &&
+					get_age(data) == generation &&
+					get_depth(data) > depth + 2)
+					return;
+				replace = &cluster.entries[i];
+				break;
+			}
+			int value = replacement_value(data);
+			if (value < replace_value) {
+				replace = &cluster.entries[i];
+				replace_value = value;
+			}
+		}
+		replace->data.store(pack_entry(key, best_move, score, depth, node_type), std::memory_order_relaxed);
 	}
 
 	/*
@@ -68,15 +327,17 @@ namespace Search {
 	 * and load the best move.
 	 */
 	int probe_hash(Key key, int depth, int alpha, int beta, Move &pv_move) {
-		Hash_entry hash_entry = hash_table[key % hash_table.capacity()];
-		if (hash_entry.zobrist_key == key) {
-			pv_move = hash_entry.best_move;
-			if (hash_entry.depth >= depth) { // Only use a value obtained with a deeper or equal search
-				if (hash_entry.node_type == HASH_EXACT)
-					return hash_entry.score;
-				if (hash_entry.node_type == HASH_ALPHA && hash_entry.score <= alpha)
+		unsigned long long data;
+		if (find_entry(key, data)) {
+			pv_move = get_best_move(data);
+			if (get_depth(data) >= depth) { // Only use a value obtained with a deeper or equal search
+				int node_type = get_node_type(data);
+				int score = get_score(data);
+				if (node_type == HASH_EXACT)
+					return score;
+				if (node_type == HASH_ALPHA && score <= alpha)
 					return alpha;
-				if (hash_entry.node_type == HASH_BETA && hash_entry.score >= beta)
+				if (node_type == HASH_BETA && score >= beta)
 					return beta;
 			}
 		}
@@ -84,37 +345,105 @@ namespace Search {
 	}
 
 	/*
-	 * Load the principal variation line in the
-	 * transposition table.
+	 * Scans the cluster of the key and loads
+	 * the entry for the position, if any.
 	 */
-	void load_pv_line(int depth, Position &pos) {
-		Move move = probe_pv_move(pos);
-		principal_variation.pv_length = 0;
-		int i = 0;
-		while (!move.is_null() && i < depth) {
-			pos.make_move(move);
-			principal_variation.moves[i] = move;
-			move = probe_pv_move(pos);
-			principal_variation.pv_length++;
-			i++;
-		}
-		while (i > 0) {
-			pos.undo_move();
-			i--;
+	bool find_entry(Key key, unsigned long long &data) {
+		Hash_cluster &cluster = get_cluster(key);
+		for (int i = 0; i < CLUSTER_SIZE; i++) {
+			unsigned long long entry_data = cluster.entries[i].data.load(std::memory_order_relaxed);
+			if (entry_data != 0 && get_key(entry_data) == key_check(key)) {
+				data = entry_data;
+				return true;
+			}
 		}
+		return false;
 	}
 
 	/*
-	 * Returns the hash move for this position, if any.
-	 * Otherwise returns a null move.
+	 * Bits of the key stored in the entry to verify it.
+	 * The cluster index depends on the upper bits, so
+	 * the lower bits are used.
 	 */
-	const Move null_move;
+	inline unsigned int key_check(Key key) {
+		return key & 0xFFFF;
+	}
 
-	Move probe_pv_move(Position &pos) {
-		Hash_entry hash_entry = hash_table[pos.get_position_key() % hash_table.capacity()];
-		if (hash_entry.zobrist_key == pos.get_position_key()) {
-			return hash_entry.best_move;
-		}
-		return null_move;
+	/*
+	 * Value of keeping an entry: deeper entries and exact
+	 * scores are worth more, older generations are worth less.
+	 */
+	int replacement_value(unsigned long long data) {
+		if (data == 0)
+			return -MAX_HASH_SCORE; // empty entry
+		int relative_age = (generation - get_age(data)) & AGE_MASK;
+		int exact_bonus = get_node_type(data) == HASH_EXACT ? 2 : 0;
+		return get_depth(data) + exact_bonus - 8 * relative_age;
+	}
+
+	/*
+	 * Packs the entry info into a single word.
+	 */
+	unsigned long long pack_entry(Key key, Move best_move, int score, int depth, int node_type) {
+		return 	key_check(key) |
+						(unsigned long long) best_move.get_move() << 16 |
+						(unsigned long long) (score_to_hash(score) & 0xFFFF) << 32 |
+						(unsigned long long) (depth & 0xFF) << 48 |
+						(unsigned long long) (node_type & 0x3) << 56 |
+						(unsigned long long) generation << 58;
+	}
+
+	/*
+	 * Unpacking of the entry info.
+	 */
+	unsigned int get_key(unsigned long long data) {
+		return data & 0xFFFF;
+	}
+
+	Move get_best_move(unsigned long long data) {
+		unsigned int move = (data >> 16) & 0xFFFF;
+		return Move(move >> 12, (move >> 6) & 0x3f, move & 0x3f);
+	}
+
+	int get_score(unsigned long long data) {
+		return score_from_hash((short) ((data >> 32) & 0xFFFF));
+	}
+
+	int get_depth(unsigned long long data) {
+		return (data >> 48) & 0xFF;
+	}
+
+	int get_node_type(unsigned long long data) {
+		return (data >> 56) & 0x3;
+	}
+
+	int get_age(unsigned long long data) {
+		return (data >> 58) & AGE_MASK;
+	}
+
+	/*
+	 * Converts a search score to the 16 bits range.
+	 */
+	int score_to_hash(int score) {
+		if (score > MATE_SCORE - MATE_BAND)
+			return score - MATE_SCORE + HASH_MATE_SCORE;
+		if (score < -MATE_SCORE + MATE_BAND)
+			return score + MATE_SCORE - HASH_MATE_SCORE;
+		if (score > MAX_HASH_SCORE)
+			return MAX_HASH_SCORE;
+		if (score < -MAX_HASH_SCORE)
+			return -MAX_HASH_SCORE;
+		return score;
+	}
+
+	/*
+	 * Converts a score from the 16 bits range.
+	 */
+	int score_from_hash(int score) {
+		if (score > MAX_HASH_SCORE)
+			return score - HASH_MATE_SCORE + MATE_SCORE;
+		if (score < -MAX_HASH_SCORE)
+			return score + HASH_MATE_SCORE - MATE_SCORE;
+		return score;
 	}
 }
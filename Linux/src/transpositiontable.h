@@ -23,14 +23,15 @@
 #ifndef SRC_TRANSPOSITIONTABLE_H_
 #define SRC_TRANSPOSITIONTABLE_H_
 
+#include <atomic>
+#include <string>
+
 #include "types.h"
 #include "move.h"
 #include "position.h"
 
 namespace Search {
 
-	// Constants
-	constexpr int PV_MAX_LENGTH = 32;
 	/*
 	 * Node types for transposition table.
 	 */
@@ -42,34 +43,46 @@ namespace Search {
 	 * Hash size limits.
 	 */
 	constexpr int MIN_HASH_SIZE = 1;
-	constexpr int MAX_HASH_SIZE = 1024;
+	constexpr int MAX_HASH_SIZE = 131072; // 128 GB
 
 	/*
 	 * Hash entry struct.
+	 * The whole entry is packed into a single atomic word, so it is
+	 * always written and read at once and the search threads can
+	 * share the table without locks. Relaxed loads and stores are
+	 * plain moves on x86-64.
+	 * Entry encoding:
+	 * 16 bits for key verification (lower bits of the key)
+	 * 16 bits for best move
+	 * 16 bits for score
+	 * 8 bits for depth
+	 * 2 bits for node type
+	 * 6 bits for search generation (age)
 	 */
 	struct Hash_entry {
-		Key zobrist_key;
-		Move best_move;
-		int score;
-		int depth;
-		int node_type;
+		std::atomic<unsigned long long> data;
 	};
 
-	// Default Hash table size
-	int constexpr default_hash_table_size = 0x100000 * 128; // 128 MB
-	int constexpr default_hash_table_entries = default_hash_table_size / sizeof(Hash_entry);
+	// Saved tables are mapped directly, the atomic must be a plain word
+	static_assert(sizeof(Hash_entry) == sizeof(unsigned long long) &&
+			std::atomic<unsigned long long>::is_always_lock_free, "Hash entries must be lock-free words");
 
+	/*
+	 * Entries are grouped in clusters that fill a cache line,
+	 * so a probe only touches one line of memory.
+	 */
+	constexpr int CLUSTER_SIZE = 8;
 
-	// Principal variation struct
-	struct PV {
-		Move moves[PV_MAX_LENGTH];
-		int pv_length;
+	struct alignas(64) Hash_cluster {
+		Hash_entry entries[CLUSTER_SIZE];
 	};
 
-	/*
-	 * Principal variation to be displayed in the search.
-	 */
-	extern PV principal_variation;
+	// Default Hash table size
+	int constexpr default_hash_table_size = 128; // 128 MB
+
+	// The table, visible here so the cluster lookup can be inlined
+	extern Hash_cluster *hash_table;
+	extern unsigned long long hash_table_clusters;
 
 	/*
 	 * Initializes the transposition table.
@@ -81,22 +94,57 @@ namespace Search {
 	 */
 	void set_transposition_table_size(int mb);
 
+	/*
+	 * Clears every entry of the transposition table,
+	 * splitting the work between threads.
+	 */
+	void clear_hash_table(int threads);
+
+	/*
+	 * Saves the transposition table to a file.
+	 * Returns true on success.
+	 */
+	bool save_hash_table(const std::string &file_name);
+
+	/*
+	 * Replaces the transposition table with the one saved in a file.
+	 * The file is memory-mapped, entries are read from disk on demand.
+	 * Returns true on success.
+	 */
+	bool load_hash_table(const std::string &file_name);
+
+	/*
+	 * Starts a new search generation.
+	 * Entries from older searches are replaced first.
+	 */
+	void new_search();
+
 	/*
 	 * Stores a hash entry into the hash table.
 	 */
 	void store_hash(Key key, Move best_move, int score, int depth, int node_type);
 
 	/*
-	 * Returns the score assigned to the position corresponding to the key,
-	 * if the hash entry for the position exists.
+	 * Returns the cluster of the key. The index is the high half
+	 * of key * clusters, which maps the key uniformly to the
+	 * table without a division.
 	 */
-	int probe_hash(Key key, int depth, int alpha, int beta, Move &pv_move);
+	inline Hash_cluster &get_cluster(Key key) {
+		return hash_table[(unsigned long long) (((unsigned __int128) key * hash_table_clusters) >> 64)];
+	}
 
 	/*
-	 * Loads the principal variation line
-	 * into an array available for the search.
+	 * Brings the cluster of the key into the cache before it is probed.
 	 */
-	void load_pv_line(int depth, Position &pos);
+	inline void prefetch(Key key) {
+		__builtin_prefetch(&get_cluster(key));
+	}
+
+	/*
+	 * Returns the score assigned to the position corresponding to the key,
+	 * if the hash entry for the position exists.
+	 */
+	int probe_hash(Key key, int depth, int alpha, int beta, Move &pv_move);
 }
 
 #endif /* SRC_TRANSPOSITIONTABLE_H_ */
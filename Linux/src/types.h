@@ -25,6 +25,13 @@
 
 typedef unsigned long long Key; // Key type for zobrist hashing.
 
+/*
+ * Middlegame and endgame values packed in one int, the endgame
+ * value in the upper 16 bits. Adding or subtracting two scores
+ * updates both values at once.
+ */
+typedef int Score;
+
 constexpr int SQUARES = 64; // number of squares
 constexpr int FILES = 8; // number of files
 constexpr int RANKS = 8; // number of ranks
@@ -113,4 +120,17 @@ constexpr Color operator~(Color c) {
   return Color(c ^ 1);
 }
 
+constexpr Score make_score(int middlegame, int endgame) {
+	return (int)((unsigned int)endgame << 16) + middlegame;
+}
+
+constexpr int middlegame_value(Score score) {
+	return (short)(unsigned short)(unsigned int)score;
+}
+
+// Rounded, the middlegame value borrows from the upper half when it's negative
+constexpr int endgame_value(Score score) {
+	return (short)(unsigned short)((unsigned int)(score + 0x8000) >> 16);
+}
+
 #endif /* SRC_TYPES_H_ */
@@ -25,12 +25,16 @@
 #include <vector>
 #include <sstream>
 #include <thread>
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
 
 #include "uci.h"
 #include "position.h"
 #include "search.h"
 #include "timemanagement.h"
 #include "transpositiontable.h"
+#include "perft.h"
 
 using namespace std;
 
@@ -43,12 +47,24 @@ namespace UCI {
 		string name;
 		string author;
 		string options;
-	} engine_info = {"MORA", "Gonzalo Arro", string("option name Hash type spin default 128 min ")+to_string(Search::MIN_HASH_SIZE)+" max "+to_string(Search::MAX_HASH_SIZE) };
+	} engine_info = {"MORA", "Gonzalo Arro",
+			string("option name Hash type spin default 128 min ")+to_string(Search::MIN_HASH_SIZE)+" max "+to_string(Search::MAX_HASH_SIZE) + "\n" +
+			string("option name Threads type spin default 1 min ")+to_string(Search::MIN_THREADS)+" max "+to_string(Search::MAX_THREADS) + "\n" +
+			string("option name Clear Hash type button\n") +
+			string("option name HashFile type string default <empty>\n") +
+			string("option name Save Hash type button\n") +
+			string("option name Load Hash type button") };
+
+	/*
+	 * File used to save and load the hash table.
+	 */
+	string hash_file = "";
 
 	// UCI Commands
-	void position(vector<string> tokens, Position &pos);
-	Search::Search_info go(vector<string> tokens, Position &pos);
+	void position(vector<string> tokens, Position &pos, deque<State_info> &game_states);
+	void go(vector<string> tokens, Position &pos, Search::Search_info &search_info);
 	void setoption(vector<string> tokens);
+	void perft(vector<string> tokens, Position &pos, bool divide);
 
 	// Helpers
 	Move parse_move(string s, Position &pos);
@@ -59,6 +75,7 @@ namespace UCI {
 	void loop() {
 
 		Position pos; // Position object to work with during the game.
+		deque<State_info> game_states; // States of the moves played in the game, one per move
 
 		Search::Search_info search_info;
 		bool searching = false;
@@ -90,7 +107,11 @@ namespace UCI {
 				cout << "readyok" << endl;
 			}
 			else if (command == "ucinewgame") {
-				// not neccesary right now...
+				if (searching) {
+					search_th.join();
+					searching = false;
+				}
+				Search::clear();
 			}
 			else if (command == "setoption") {
 				setoption(tokens);
@@ -100,25 +121,32 @@ namespace UCI {
 					search_th.join();
 					searching = false;
 				}
-				position(tokens, pos);
+				position(tokens, pos, game_states);
 			}
 			else if (command == "go") {
 				if (searching)
 					search_th.join();
-				search_info = go(tokens, pos);
+				go(tokens, pos, search_info);
 				search_th = std::thread(&Search::search, std::ref(pos), std::ref(search_info));
 				searching = true;
 			}
 			else if (command == "stop") {
 				if (searching) {
-					search_info.stop = true;
+					search_info.stop.store(true, std::memory_order_relaxed);
+					search_th.join();
+					searching = false;
+				}
+			}
+			else if (command == "perft" || command == "divide") {
+				if (searching) {
 					search_th.join();
 					searching = false;
 				}
+				perft(tokens, pos, command == "divide");
 			}
 			else if (command == "quit") {
 				if (searching) {
-					search_info.stop = true;
+					search_info.stop.store(true, std::memory_order_relaxed);
 					search_th.join();
 				}
 				break;
@@ -128,39 +156,109 @@ namespace UCI {
 
 	/*
 	 * Implements the UCI setoption command.
-	 * For the moment Hash is the only option available.
+	 * Options available: Hash, Threads, Clear Hash, HashFile, Save Hash and Load Hash.
 	 */
 	void setoption(vector<string> tokens) {
 		vector<string>::iterator it = tokens.begin();
 		vector<string>::iterator end = tokens.end();
 		it++;
-		if (it != end) {
-			if (*it != "name") {
-				return;
-			}
+		if (it == end || *it != "name")
+			return;
+		it++;
+		// Option name (may contain spaces)
+		string name = "";
+		while (it != end && *it != "value") {
+			name += name.empty() ? *it : " " + *it;
 			it++;
 		}
-		if (it !=end && *it == "Hash") {
+		// Option value (may contain spaces)
+		string value = "";
+		if (it != end) {
 			it++;
-			if (it != end) {
-				if (*it != "value") {
-					return;
-				}
+			while (it != end) {
+				value += value.empty() ? *it : " " + *it;
 				it++;
 			}
+		}
+
+		if (name == "Hash" && !value.empty()) {
+			int hash_size_mb = std::stoi(value);
+			Search::set_transposition_table_size(hash_size_mb);
+			Search::clear();
+		}
+		else if (name == "Threads" && !value.empty()) {
+			int threads = std::stoi(value);
+			Search::set_threads(threads);
+		}
+		else if (name == "Clear Hash") {
+			Search::clear();
+		}
+		else if (name == "HashFile") {
+			hash_file = value == "<empty>" ? "" : value;
+		}
+		else if ((name == "Save Hash" || name == "Load Hash") && hash_file.empty()) {
+			cout << "info string no HashFile set" << endl;
+		}
+		else if (name == "Save Hash") {
+			if (Search::save_hash_table(hash_file))
+				cout << "info string hash table saved to " << hash_file << endl;
+			else
+				cout << "info string could not save the hash table to " << hash_file << endl;
+		}
+		else if (name == "Load Hash") {
+			if (Search::load_hash_table(hash_file))
+				cout << "info string hash table loaded from " << hash_file << endl;
+			else
+				cout << "info string could not load the hash table from " << hash_file << endl;
+		}
+	}
+
+	/*
+	 * Implements the perft and divide commands (not part of UCI).
+	 * Usage: perft <depth> [hash <mb>] [threads <n>]
+	 */
+	void perft(vector<string> tokens, Position &pos, bool divide) {
+		vector<string>::iterator it = tokens.begin();
+		vector<string>::iterator end = tokens.end();
+		it++;
+		int depth = 0;
+		int hash_size_mb = 0;
+		int threads = 1;
+		try {
 			if (it != end) {
-				int hash_size_mb = std::stoi(*it);
-				Search::set_transposition_table_size(hash_size_mb);
+				depth = std::stoi(*it);
+				it++;
+			}
+			while (it != end) {
+				if (*it == "hash" && it + 1 != end) {
+					it++;
+					hash_size_mb = std::stoi(*it);
+				}
+				else if (*it == "threads" && it + 1 != end) {
+					it++;
+					threads = std::stoi(*it);
+				}
+				it++;
 			}
 		}
+		catch (const std::logic_error &) { // invalid_argument or out_of_range from stoi
+			cout << "info string usage: " << tokens[0] << " <depth> [hash <mb>] [threads <n>]" << endl;
+			return;
+		}
+		// Same limits as the Hash and Threads options
+		hash_size_mb = std::min(std::max(0, hash_size_mb), Search::MAX_HASH_SIZE);
+		threads = std::min(std::max(Search::MIN_THREADS, threads), Search::MAX_THREADS);
+		Perft::run(pos, depth, divide, hash_size_mb, threads);
 	}
 
 	/*
 	 * Implements the UCI position command.
 	 * Loads the starting position or a FEN and
 	 * then makes moves over that position.
+	 * The states of the moves are kept in game_states, so
+	 * the game history has no length limit.
 	 */
-	void position(vector<string> tokens, Position &pos) {
+	void position(vector<string> tokens, Position &pos, deque<State_info> &game_states) {
 		vector<string>::iterator it = tokens.begin();
 		vector<string>::iterator end = tokens.end();
 		it++;
@@ -168,6 +266,7 @@ namespace UCI {
 		if (it != end) {
 			if (*it == "startpos") {
 				pos.load_FEN("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+				game_states.clear();
 				it++;
 			}
 			else if (*it == "fen") {
@@ -180,6 +279,7 @@ namespace UCI {
 						fen += " ";
 				}
 				pos.load_FEN(fen);
+				game_states.clear();
 			}
 		}
 		// Moves
@@ -188,7 +288,8 @@ namespace UCI {
 			while (it != end) {
 				string move_string = *it;
 				Move move = parse_move(move_string, pos);
-				pos.make_move(move);
+				game_states.emplace_back();
+				pos.make_move(move, game_states.back());
 				it++;
 			}
 		}
@@ -237,9 +338,9 @@ namespace UCI {
 	}
 
 	/*
-	 * Returns the necessary info for the search.
+	 * Fills the necessary info for the search.
 	 */
-	Search::Search_info go(vector<string> tokens, Position &pos) {
+	void go(vector<string> tokens, Position &pos, Search::Search_info &search_info) {
 
 		Time::Time_options options;
 		options.infinite = false;
@@ -283,13 +384,9 @@ namespace UCI {
 
 		int time_to_search = movetime > 0 ? movetime : Time::get_time_to_search(options, pos.get_history_ply());
 
-		Search::Search_info search_info;
 		search_info.depth = depth;
 		search_info.time_to_search = time_to_search;
-		search_info.nodes = 0;
 		search_info.start_time = Time::get_current_time_in_milliseconds();
-		search_info.stop = false;
-
-		return search_info;
+		search_info.stop.store(false, std::memory_order_relaxed);
 	}
 }